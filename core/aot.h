@@ -0,0 +1,348 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "cir.h"
+
+// Emits C++ for a Program: every Function becomes a native function over the VM's register file and every op
+// straight-line code between goto labels. Built into a shared object it is loaded with CIR::load_native().
+// Ops without a direct translation (locals, heap, casts, externs, ...) go through CIR::execute_op on the original op.
+class NativeEmitter {
+    const Program &program;
+    std::vector<std::string> names;
+
+    [[nodiscard]] size_t index_of(const std::string &name) const {
+        return std::lower_bound(names.begin(), names.end(), name) - names.begin();
+    }
+
+    [[nodiscard]] bool defined(const std::string &name) const {
+        return std::binary_search(names.begin(), names.end(), name);
+    }
+
+    static std::string reg(const Op &op, size_t i) {
+        return "r[" + std::to_string(op.args[i].as_int()) + "]";
+    }
+
+    static std::string quote(const std::string &s) {
+        std::string out = "\"";
+        for (char c: s) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    static std::string constant(const Word &w) {
+        switch (w.type) {
+            case WordType::Integer: return "Word::from_int(INT64_C(" + std::to_string(w.as_int()) + "))";
+            case WordType::Float: {
+                uint64_t bits;
+                std::memcpy(&bits, &w.data.f, sizeof(bits));
+                return "Word::from_float(std::bit_cast<double>(UINT64_C(" + std::to_string(bits) + ")))";
+            }
+            case WordType::Boolean: return w.as_bool() ? "Word::from_bool(true)" : "Word::from_bool(false)";
+            case WordType::Null: return "Word::from_null()";
+            default: return "";
+        }
+    }
+
+    [[nodiscard]] std::string call(const Op &op) const {
+        const char *target = op.args[0].has_flag(WordFlag::String)
+                                 ? static_cast<const char *>(op.args[0].as_ptr())
+                                 : nullptr;
+        if (!target || !defined(target)) {
+            return "throw std::runtime_error(" + quote("Function not found: " + std::string(target ? target : "")) +
+                   ");";
+        }
+        return "cas_fn_" + std::to_string(index_of(target)) + "(vm);";
+    }
+
+    void emit_op(std::ostringstream &out, const Function &fn, size_t i) const {
+        const Op &op = fn.ops[i];
+        auto jump = [&](const std::string &cond) {
+            int64_t target = op.args[0].as_int() + 1;
+            std::string go = target >= 0 && static_cast<size_t>(target) < fn.ops.size()
+                                 ? "goto L" + std::to_string(target) + ";"
+                                 : "return;";
+            out << "    " << (cond.empty() ? "" : "if (" + cond + ") ") << go << "\n";
+        };
+        auto binary = [&](const char *make, const char *field, const char *oper) {
+            out << "    r[0] = Word::" << make << "(" << reg(op, 0) << ".data." << field << " " << oper << " "
+                    << reg(op, 1) << ".data." << field << ");\n";
+        };
+        auto typed = [&](const std::string &dst, const std::string &value) {
+            out << "    set_int(" << dst << ", " << value << ");\n";
+        };
+        auto compare = [&](const char *field, const char *oper) {
+            out << "    flag = " << reg(op, 0) << ".data." << field << " " << oper << " " << reg(op, 1) << ".data." <<
+                    field << ";\n";
+        };
+        // same conversions as CIR::load / CIR::store
+        auto memory = [&](const char *type, bool floating) {
+            MemOperand mem = MemOperand::unpack(op.args[2].as_int());
+            out << "    {\n        auto *base = static_cast<uint8_t *>(" << reg(op, 1) << ".data.p);\n";
+            out << "        if (!base) throw std::runtime_error(\"Memory access through a null pointer\");\n";
+            out << "        uint8_t *at = base";
+            if (mem.index >= 0) out << " + r[" << mem.index << "].data.i * " << static_cast<int>(mem.scale);
+            if (mem.offset != 0) out << " + INT64_C(" << mem.offset << ")";
+            out << ";\n        " << type << " v;\n";
+            if (is_load(op.type)) {
+                out << "        std::memcpy(&v, at, sizeof(v));\n";
+                out << "        " << reg(op, 0) << " = " << (floating ? "Word::from_float(v)" : "Word::from_int(v)") << ";\n";
+            } else {
+                out << "        v = static_cast<" << type << ">(" << reg(op, 0) << (floating ? ".data.f" : ".data.i") << ");\n";
+                out << "        std::memcpy(at, &v, sizeof(v));\n";
+            }
+            out << "    }\n";
+        };
+        auto fallback = [&] {
+            out << "    vm.execute_op(fn, fn.ops[" << i << "]);\n";
+        };
+
+        // fat pointers are checked by the VM. Natives are loaded into a CIR, so its policy decides.
+        bool pointer_op = is_memory_op(op.type) || op.type == OpType::PAdd || op.type == OpType::PSub;
+        if (CIR::PolicyType::FAT_POINTERS && pointer_op) {
+            fallback();
+            return;
+        }
+
+        switch (op.type) {
+            case OpType::Mov:
+                if (op.args[0].has_flag(WordFlag::Register)) {
+                    out << "    " << reg(op, 1) << " = " << reg(op, 0) << ";\n";
+                } else if (!constant(op.args[0]).empty()) {
+                    out << "    " << reg(op, 1) << " = " << constant(op.args[0]) << ";\n";
+                } else {
+                    fallback(); // strings are copied by the VM
+                }
+                break;
+
+            case OpType::MovInt: typed(reg(op, 1), "INT64_C(" + std::to_string(op.args[0].as_int()) + ")");
+                break;
+
+            case OpType::PushReg: out << "    vm.push(" << reg(op, 0) << ");\n";
+                break;
+            case OpType::Pop: out << "    " << reg(op, 0) << " = vm.pop();\n";
+                break;
+
+            case OpType::IAdd: binary("from_int", "i", "+");
+                break;
+            case OpType::ISub: binary("from_int", "i", "-");
+                break;
+            case OpType::IMul: binary("from_int", "i", "*");
+                break;
+            case OpType::IAnd: binary("from_int", "i", "&");
+                break;
+            case OpType::IOr: binary("from_int", "i", "|");
+                break;
+            case OpType::IXor: binary("from_int", "i", "^");
+                break;
+            case OpType::Shl: binary("from_int", "i", "<<");
+                break;
+            case OpType::Shr: binary("from_int", "i", ">>");
+                break;
+            case OpType::FAdd: binary("from_float", "f", "+");
+                break;
+            case OpType::FSub: binary("from_float", "f", "-");
+                break;
+            case OpType::FMul: binary("from_float", "f", "*");
+                break;
+            case OpType::FDiv: binary("from_float", "f", "/");
+                break;
+
+            case OpType::IDiv:
+            case OpType::IMod: {
+                bool div = op.type == OpType::IDiv;
+                out << "    if (" << reg(op, 1) << ".data.i == 0) throw std::runtime_error(\""
+                        << (div ? "Division" : "Modulo") << " by zero\");\n";
+                binary("from_int", "i", div ? "/" : "%");
+            }
+            break;
+
+            case OpType::IAddInt: typed("r[0]", reg(op, 0) + ".data.i + " + reg(op, 1) + ".data.i");
+                break;
+            case OpType::ISubInt: typed("r[0]", reg(op, 0) + ".data.i - " + reg(op, 1) + ".data.i");
+                break;
+            case OpType::IMulInt: typed("r[0]", reg(op, 0) + ".data.i * " + reg(op, 1) + ".data.i");
+                break;
+            case OpType::IncInt: typed(reg(op, 0), reg(op, 0) + ".data.i + 1");
+                break;
+            case OpType::DecInt: typed(reg(op, 0), reg(op, 0) + ".data.i - 1");
+                break;
+
+            case OpType::Inc: out << "    " << reg(op, 0) << " = Word::from_int(" << reg(op, 0) << ".data.i + 1);\n";
+                break;
+            case OpType::Dec: out << "    " << reg(op, 0) << " = Word::from_int(" << reg(op, 0) << ".data.i - 1);\n";
+                break;
+            case OpType::Neg: out << "    r[0] = Word::from_int(-" << reg(op, 0) << ".data.i);\n";
+                break;
+            case OpType::Not: out << "    r[0] = Word::from_int(~" << reg(op, 0) << ".data.i);\n";
+                break;
+
+            case OpType::I2F: out << "    r[0] = Word::from_float(static_cast<double>(" << reg(op, 0) << ".data.i));\n";
+                break;
+            case OpType::F2I: out << "    r[0] = Word::from_int(static_cast<int64_t>(" << reg(op, 0) << ".data.f));\n";
+                break;
+            case OpType::PAdd:
+            case OpType::PSub:
+                out << "    r[0] = Word::from_ptr(static_cast<uint8_t *>(" << reg(op, 0) << ".data.p) "
+                        << (op.type == OpType::PAdd ? "+" : "-") << " " << reg(op, 1) << ".data.i);\n";
+                break;
+            case OpType::PDiff:
+                out << "    r[0] = Word::from_int(static_cast<uint8_t *>(" << reg(op, 0) << ".data.p) - "
+                        << "static_cast<uint8_t *>(" << reg(op, 1) << ".data.p));\n";
+                break;
+            case OpType::P2I: out << "    r[0] = Word::from_int((int64_t) " << reg(op, 0) << ".data.p);\n";
+                break;
+            case OpType::I2P: out << "    r[0] = Word::from_ptr((void *) " << reg(op, 0) << ".data.i);\n";
+                break;
+
+            case OpType::ICmp: compare("i", "==");
+                break;
+            case OpType::Gt: compare("i", ">");
+                break;
+            case OpType::Lt: compare("i", "<");
+                break;
+            case OpType::Gte: compare("i", ">=");
+                break;
+            case OpType::Lte: compare("i", "<=");
+                break;
+            case OpType::FCmp: compare("f", "==");
+                break;
+
+            case OpType::Jmp: jump("");
+                break;
+            case OpType::Je: jump("flag");
+                break;
+            case OpType::Jne: jump("!flag");
+                break;
+
+            case OpType::Call: out << "    " << call(op) << "\n    if (!vm.is_running()) return;\n";
+                break;
+            case OpType::TailCall: out << "    " << call(op) << "\n    return;\n";
+                break;
+            case OpType::CallReg:
+                out << "    vm.invoke(static_cast<Config::DI_TYPE>(" << reg(op, 0) << ".data.i));\n";
+                out << "    if (!vm.is_running()) return;\n";
+                break;
+
+            case OpType::LdI8: memory("int8_t", false);
+                break;
+            case OpType::LdI16: memory("int16_t", false);
+                break;
+            case OpType::LdI32: memory("int32_t", false);
+                break;
+            case OpType::LdI64: memory("int64_t", false);
+                break;
+            case OpType::LdU8: memory("uint8_t", false);
+                break;
+            case OpType::LdU16: memory("uint16_t", false);
+                break;
+            case OpType::LdU32: memory("uint32_t", false);
+                break;
+            case OpType::LdF32: memory("float", true);
+                break;
+            case OpType::LdF64: memory("double", true);
+                break;
+            case OpType::StI8: memory("int8_t", false);
+                break;
+            case OpType::StI16: memory("int16_t", false);
+                break;
+            case OpType::StI32: memory("int32_t", false);
+                break;
+            case OpType::StI64: memory("int64_t", false);
+                break;
+            case OpType::StF32: memory("float", true);
+                break;
+            case OpType::StF64: memory("double", true);
+                break;
+
+            case OpType::Ret: out << "    return;\n";
+                break;
+            case OpType::Halt: out << "    vm.halt();\n    return;\n";
+                break;
+            case OpType::Nop: break;
+
+            default: fallback();
+                break;
+        }
+    }
+
+public:
+    explicit NativeEmitter(const Program &program) : program(program) {
+        for (const auto &[name, fn]: program.functions) names.push_back(name);
+        // same order as CIR::link_functions, so the index of a function is its id
+        std::sort(names.begin(), names.end());
+    }
+
+    [[nodiscard]] std::string emit() const {
+        std::ostringstream out;
+        out << "// generated by casc, do not edit\n";
+        out << "#include <bit>\n#include <cstring>\n#include <stdexcept>\n#include <string>\n\n";
+        out << "#include \"core/cir.h\"\n\n";
+        out << "namespace {\n";
+        out << "Function *functions[" << std::max<size_t>(names.size(), 1) << "];\n\n";
+        out << "struct ScratchScope {\n    CIR &vm;\n    uint32_t mark;\n\n";
+        out << "    ~ScratchScope() { vm.release_scratch(mark); }\n};\n\n";
+        out << "thread_local int call_depth = 0;\n\n";
+        out << "struct DepthScope {\n    DepthScope() {\n";
+        out << "        if (++call_depth > Config::NATIVE_CALL_DEPTH) {\n            call_depth--;\n";
+        out << "            throw std::runtime_error(\"Stack overflow: native calls nested deeper than \" +\n";
+        out << "                                     std::to_string(Config::NATIVE_CALL_DEPTH));\n        }\n    }\n\n";
+        out << "    ~DepthScope() { call_depth--; }\n};\n\n";
+        out << "inline void set_int(Word &w, int64_t v) {\n";
+        out << "    w.type = WordType::Integer;\n    w.flags = 0;\n    w.data.i = v;\n}\n\n";
+
+        for (size_t id = 0; id < names.size(); id++) out << "void cas_fn_" << id << "(CIR &vm);\n";
+
+        for (size_t id = 0; id < names.size(); id++) {
+            const Function &fn = program.functions.at(names[id]);
+
+            std::unordered_set<size_t> labels;
+            for (const auto &op: fn.ops) {
+                if (op.type == OpType::Jmp || op.type == OpType::Je || op.type == OpType::Jne) {
+                    labels.insert(static_cast<size_t>(op.args[0].as_int() + 1));
+                }
+            }
+
+            out << "\n// " << names[id] << "\n";
+            out << "void cas_fn_" << id << "(CIR &vm) {\n";
+            out << "    Word *r = vm.register_file();\n";
+            out << "    bool &flag = vm.compare_flag();\n";
+            out << "    Function &fn = *functions[" << id << "];\n";
+            out << "    (void) r;\n    (void) flag;\n    (void) fn;\n";
+            // only a function that calls can be part of a recursion
+            if (std::any_of(fn.ops.begin(), fn.ops.end(), [](const Op &op) {
+                return op.type == OpType::Call || op.type == OpType::TailCall || op.type == OpType::CallReg;
+            })) {
+                out << "    DepthScope depth;\n";
+            }
+            // salloc runs in the VM, its memory is released on every return
+            if (std::any_of(fn.ops.begin(), fn.ops.end(), [](const Op &op) { return op.type == OpType::SAlloc; })) {
+                out << "    ScratchScope scratch{vm, vm.scratch_mark()};\n";
+            }
+            for (size_t i = 0; i < fn.ops.size(); i++) {
+                if (labels.contains(i)) out << "L" << i << ":\n";
+                emit_op(out, fn, i);
+            }
+            out << "}\n";
+        }
+        out << "}\n\n";
+
+        out << "extern \"C\" void cir_init_native(CIR &vm) {\n";
+        for (size_t id = 0; id < names.size(); id++) {
+            const Function &fn = program.functions.at(names[id]);
+            out << "    if (vm.set_native_fn(" << quote(names[id]) << ", UINT64_C(" << function_fingerprint(fn)
+                    << "), cas_fn_" << id << ")) {\n";
+            out << "        functions[" << id << "] = &vm.get_function(vm.function_id(" << quote(names[id]) << "));\n";
+            out << "    }\n";
+        }
+        out << "}\n";
+        return out.str();
+    }
+};
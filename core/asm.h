@@ -9,11 +9,21 @@
 #include <unordered_set>
 #include <cctype>
 #include <algorithm>
+#include <optional>
 #include "cir.h"
+#include "optimizer.h"
 #include "helpers/scalc.h"
 
 struct FunctionAttributes {
     bool is_inline = false;
+    bool is_noinline = false;
+};
+
+struct LabelRef {
+    std::string function;
+    size_t op;
+    size_t arg;
+    std::string label;
 };
 
 struct OpCodeInfo {
@@ -24,15 +34,30 @@ struct OpCodeInfo {
 class Assembler {
 public:
     bool show_better_practice = true;
+    bool tail_call_elimination = true;
+    bool optimize = true;
+    bool auto_inline = true;
+    size_t inline_threshold = 8; // max ops of a leaf function that is inlined automatically
+    size_t hot_inline_threshold = 32; // same for calls from call sites the profile shows as hot, need not be leaves
+    // keeps the op layout of the source (no inlining, optimization or tail calls) so a profile recorded from
+    // this build maps back onto the source
+    bool instrumented = false;
+    std::optional<Profile> profile; // from a previous instrumented run, see load_profile()
+    // profiled calls made from each op of a function, kept in step with its ops through block layout
+    std::unordered_map<std::string, std::vector<uint64_t> > site_calls;
     std::unordered_map<std::string, OpCodeInfo> opcode_map;
+    std::vector<cir_opt::RegisterPressure> register_report; // filled by the optimizer
+    std::vector<cir_opt::TypeSite> type_report;
 
 private:
     std::unordered_map<std::string, std::unordered_map<std::string, size_t> > labels;
     std::unordered_map<std::string, FunctionAttributes> function_attributes;
-    std::unordered_set<std::string> forward_label_refs;
+    std::vector<LabelRef> forward_label_refs;
     Program program;
     std::string current_function;
     size_t line_number = 0;
+    size_t current_op = 0;
+    size_t current_arg = 0;
 
     CTEE ctee{};
 
@@ -41,6 +66,8 @@ private:
         opcode_map["halt"] = {OpType::Halt, 0};
         opcode_map["nop"] = {OpType::Nop, 0};
         opcode_map["ret"] = {OpType::Ret, 0};
+        opcode_map["arr.new"] = {OpType::ArrNew, 0};
+        opcode_map["map.new"] = {OpType::MapNew, 0};
 
         // 1 operand
         opcode_map["not"] = {OpType::Not, 1};
@@ -55,7 +82,30 @@ private:
         opcode_map["jne"] = {OpType::Jne, 1};
         opcode_map["call"] = {OpType::Call, 1};
         opcode_map["callx"] = {OpType::CallExtern, 1};
+        opcode_map["callr"] = {OpType::CallReg, 1};
+        opcode_map["tailcall"] = {OpType::TailCall, 1};
         opcode_map["local.get"] = {OpType::LocalGet, 1};
+        opcode_map["alloc"] = {OpType::Alloc, 1};
+        opcode_map["free"] = {OpType::Free, 1};
+        opcode_map["region.new"] = {OpType::RegionNew, 1};
+        opcode_map["region.free_all"] = {OpType::RegionFreeAll, 1};
+        opcode_map["arr.len"] = {OpType::ArrLen, 1};
+        opcode_map["str.len"] = {OpType::StrLen, 1};
+        opcode_map["arr.free"] = {OpType::ArrFree, 1};
+        opcode_map["map.len"] = {OpType::MapLen, 1};
+        opcode_map["map.free"] = {OpType::MapFree, 1};
+        opcode_map["vsum.i64x4"] = {OpType::VSumI64, 1};
+        opcode_map["vmin.i64x4"] = {OpType::VMinI64, 1};
+        opcode_map["vmax.i64x4"] = {OpType::VMaxI64, 1};
+        opcode_map["vsum.f64x4"] = {OpType::VSumF64, 1};
+        opcode_map["vmin.f64x4"] = {OpType::VMinF64, 1};
+        opcode_map["vmax.f64x4"] = {OpType::VMaxF64, 1};
+        opcode_map["inc.i"] = {OpType::IncInt, 1};
+        opcode_map["dec.i"] = {OpType::DecInt, 1};
+        opcode_map["i2f"] = {OpType::I2F, 1};
+        opcode_map["f2i"] = {OpType::F2I, 1};
+        opcode_map["p2i"] = {OpType::P2I, 1};
+        opcode_map["i2p"] = {OpType::I2P, 1};
 
 
         // 2 operands
@@ -82,10 +132,69 @@ private:
         opcode_map["fcmp"] = {OpType::FCmp, 2};
         opcode_map["cast"] = {OpType::Cast, 2};
         opcode_map["local.set"] = {OpType::LocalSet, 2};
+        opcode_map["fnref"] = {OpType::FnRef, 2};
+        opcode_map["mov.i"] = {OpType::MovInt, 2};
+        opcode_map["iadd.i"] = {OpType::IAddInt, 2};
+        opcode_map["isub.i"] = {OpType::ISubInt, 2};
+        opcode_map["imul.i"] = {OpType::IMulInt, 2};
+        opcode_map["pushn"] = {OpType::PushN, 2};
+        opcode_map["popn"] = {OpType::PopN, 2};
+        opcode_map["padd"] = {OpType::PAdd, 2};
+        opcode_map["psub"] = {OpType::PSub, 2};
+        opcode_map["pdiff"] = {OpType::PDiff, 2};
+        opcode_map["region.alloc"] = {OpType::RegionAlloc, 2};
+        opcode_map["salloc"] = {OpType::SAlloc, 2};
+        opcode_map["arr.push"] = {OpType::ArrPush, 2};
+        opcode_map["arr.get"] = {OpType::ArrGet, 2};
+        opcode_map["map.get"] = {OpType::MapGet, 2};
+        opcode_map["map.find"] = {OpType::MapFind, 2};
+        opcode_map["str.concat"] = {OpType::StrConcat, 2};
+        opcode_map["str.eq"] = {OpType::StrEq, 2};
+        opcode_map["map.del"] = {OpType::MapDel, 2};
+        opcode_map["vmov"] = {OpType::VMov, 2};
+        opcode_map["vsplat"] = {OpType::VSplat, 2};
 
         // 3 operands
         opcode_map["load"] = {OpType::Load, 3};
         opcode_map["store"] = {OpType::Store, 3};
+        opcode_map["arr.set"] = {OpType::ArrSet, 3};
+        opcode_map["map.set"] = {OpType::MapSet, 3};
+        opcode_map["vadd.i64x4"] = {OpType::VAddI64, 3};
+        opcode_map["vsub.i64x4"] = {OpType::VSubI64, 3};
+        opcode_map["vmul.i64x4"] = {OpType::VMulI64, 3};
+        opcode_map["vadd.f64x4"] = {OpType::VAddF64, 3};
+        opcode_map["vsub.f64x4"] = {OpType::VSubF64, 3};
+        opcode_map["vmul.f64x4"] = {OpType::VMulF64, 3};
+        opcode_map["vdiv.f64x4"] = {OpType::VDivF64, 3};
+        opcode_map["vcmpeq.i64x4"] = {OpType::VCmpEqI64, 3};
+        opcode_map["vcmpgt.i64x4"] = {OpType::VCmpGtI64, 3};
+        opcode_map["vcmpeq.f64x4"] = {OpType::VCmpEqF64, 3};
+        opcode_map["vcmpgt.f64x4"] = {OpType::VCmpGtF64, 3};
+        opcode_map["vblend"] = {OpType::VBlend, 3};
+        opcode_map["memset"] = {OpType::MemSet, 3};
+        opcode_map["memcmp"] = {OpType::MemCmp, 3};
+        opcode_map["memchr"] = {OpType::MemChr, 3};
+        opcode_map["memmove"] = {OpType::MemMove, 3};
+        opcode_map["str.slice"] = {OpType::StrSlice, 3};
+
+        // register and memory operand, the address takes args[1] and args[2]
+        opcode_map["ld.i8"] = {OpType::LdI8, 3};
+        opcode_map["ld.i16"] = {OpType::LdI16, 3};
+        opcode_map["ld.i32"] = {OpType::LdI32, 3};
+        opcode_map["ld.i64"] = {OpType::LdI64, 3};
+        opcode_map["ld.u8"] = {OpType::LdU8, 3};
+        opcode_map["ld.u16"] = {OpType::LdU16, 3};
+        opcode_map["ld.u32"] = {OpType::LdU32, 3};
+        opcode_map["ld.f32"] = {OpType::LdF32, 3};
+        opcode_map["ld.f64"] = {OpType::LdF64, 3};
+        opcode_map["st.i8"] = {OpType::StI8, 3};
+        opcode_map["st.i16"] = {OpType::StI16, 3};
+        opcode_map["st.i32"] = {OpType::StI32, 3};
+        opcode_map["st.i64"] = {OpType::StI64, 3};
+        opcode_map["st.f32"] = {OpType::StF32, 3};
+        opcode_map["st.f64"] = {OpType::StF64, 3};
+        opcode_map["vload"] = {OpType::VLoad, 3};
+        opcode_map["vstore"] = {OpType::VStore, 3};
     }
 
     std::string trim(const std::string &str) {
@@ -170,10 +279,13 @@ private:
 
         if (op[0] == '@') {
             std::string label = op.substr(1);
-            if (labels[current_function].find(label) == labels[current_function].end()) {
-                forward_label_refs.insert(current_function + ":" + label);
+            auto it = labels[current_function].find(label);
+            if (it == labels[current_function].end()) {
+                // patched by verify_labels() once the whole function is known
+                forward_label_refs.push_back({current_function, current_op, current_arg, label});
+                return Word::from_int(-1);
             }
-            return Word::from_int(static_cast<int64_t>(labels[current_function][label]) - 1);
+            return Word::from_int(static_cast<int64_t>(it->second) - 1);
         }
 
         if (op[0] == '#') {
@@ -190,6 +302,15 @@ private:
             return Word::from_reg(reg_num);
         }
 
+        if (op[0] == 'v' && op.size() > 1 && std::isdigit(op[1])) {
+            int reg_num = std::stoi(op.substr(1));
+            if (reg_num < 0 || reg_num >= Config::VECTOR_REGISTER_COUNT) {
+                throw std::runtime_error("Invalid vector register v" + std::to_string(reg_num) + " (valid range: v0-v" +
+                                         std::to_string(Config::VECTOR_REGISTER_COUNT - 1) + ")");
+            }
+            return Word::from_vreg(reg_num);
+        }
+
         if (op[0] == '"' && op.back() == '"') {
             std::string str = op.substr(1, op.size() - 2);
             std::string unescaped;
@@ -321,6 +442,70 @@ private:
         return Word::from_string_owned(op);
     }
 
+    // [rBase], [rBase + imm], [rBase + rIdx], [rBase + rIdx*8 - imm], ... into args[1] (base) and args[2] (MemOperand)
+    void parse_address(const std::string &operand, Op &op) {
+        std::string text = trim(operand);
+        if (text.size() < 2 || text.front() != '[' || text.back() != ']') {
+            throw std::runtime_error("Expected a memory operand like [rBase + rIdx*8 + imm], got: " + operand);
+        }
+        text = text.substr(1, text.size() - 2);
+
+        // split into signed terms
+        std::vector<std::pair<bool, std::string> > terms;
+        bool negative = false;
+        std::string term;
+        for (char c: text) {
+            if (c == '+' || c == '-') {
+                if (!trim(term).empty()) terms.emplace_back(negative, trim(term));
+                term.clear();
+                negative = c == '-';
+            } else {
+                term += c;
+            }
+        }
+        if (!trim(term).empty()) terms.emplace_back(negative, trim(term));
+
+        auto parse_reg = [&](const std::string &t) {
+            Word w = parse_operand(t);
+            if (!w.has_flag(WordFlag::Register)) throw std::runtime_error("Expected a register in address: " + t);
+            return w.as_int();
+        };
+
+        bool has_base = false;
+        MemOperand mem;
+        int64_t offset = 0;
+        for (const auto &[neg, t]: terms) {
+            size_t star = t.find('*');
+            if (t[0] == 'r' && (star != std::string::npos || !has_base)) {
+                if (neg) throw std::runtime_error("Registers can not be subtracted in an address: " + operand);
+                if (star == std::string::npos) {
+                    op.args[1] = Word::from_reg(parse_reg(t));
+                    has_base = true;
+                    continue;
+                }
+                if (mem.index >= 0) throw std::runtime_error("Address has more than one index: " + operand);
+                mem.index = static_cast<int16_t>(parse_reg(trim(t.substr(0, star))));
+                int64_t scale = std::stoll(trim(t.substr(star + 1)));
+                if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+                    throw std::runtime_error("Scale must be 1, 2, 4 or 8: " + operand);
+                }
+                mem.scale = static_cast<uint8_t>(scale);
+            } else if (t[0] == 'r') {
+                if (mem.index >= 0) throw std::runtime_error("Address has more than one index: " + operand);
+                mem.index = static_cast<int16_t>(parse_reg(t));
+            } else {
+                // $ is optional inside brackets
+                int64_t value = std::stoll(t[0] == '$' ? t.substr(1) : t, nullptr, 0);
+                offset += neg ? -value : value;
+            }
+        }
+
+        if (!has_base) throw std::runtime_error("Address has no base register: " + operand);
+        if (offset < INT32_MIN || offset > INT32_MAX) throw std::runtime_error("Address offset out of range: " + operand);
+        mem.offset = static_cast<int32_t>(offset);
+        op.args[2] = Word::from_int(mem.pack());
+    }
+
     void validate_instruction(const Op &op, const std::string &opcode, size_t expected_args) {
         size_t provided_args = 0;
         for (size_t i = 0; i < Config::OpArgCount; i++) {
@@ -389,8 +574,18 @@ private:
                                          "' (max " + std::to_string(Config::OpArgCount) + ")");
             }
 
-            for (size_t i = 0; i < operands.size() && i < Config::OpArgCount; i++) {
-                op.args[i] = parse_operand(operands[i], is_jump && i == 0);
+            current_op = func.ops.size();
+            if (is_memory_op(op.type)) {
+                if (operands.size() != 2) {
+                    throw std::runtime_error("Instruction '" + opcode + "' expects a register and a memory operand");
+                }
+                op.args[0] = parse_operand(operands[0]);
+                parse_address(operands[1], op);
+            } else {
+                for (size_t i = 0; i < operands.size() && i < Config::OpArgCount; i++) {
+                    current_arg = i;
+                    op.args[i] = parse_operand(operands[i], is_jump && i == 0);
+                }
             }
         }
 
@@ -400,12 +595,25 @@ private:
 
     void verify_labels() {
         for (const auto &ref: forward_label_refs) {
-            size_t colon_pos = ref.find(':');
-            std::string func_name = ref.substr(0, colon_pos);
-            std::string label = ref.substr(colon_pos + 1);
+            auto it = labels[ref.function].find(ref.label);
+            if (it == labels[ref.function].end()) {
+                throw std::runtime_error("Undefined label '" + ref.label + "' in function '" + ref.function + "'");
+            }
+
+            program.functions[ref.function].ops[ref.op].args[ref.arg] =
+                    Word::from_int(static_cast<int64_t>(it->second) - 1);
+        }
+    }
 
-            if (labels[func_name].find(label) == labels[func_name].end()) {
-                throw std::runtime_error("Undefined label '" + label + "' in function '" + func_name + "'");
+    // jumps are rewritten by inlining and the optimizer, which need a resolved target to move them correctly
+    void verify_jumps() {
+        for (const auto &[func_name, func]: program.functions) {
+            for (const auto &op: func.ops) {
+                if (!is_jump_op(op.type) || op.args[0].type == WordType::Integer) continue;
+                std::string operand = op.args[0].has_flag(WordFlag::String)
+                                          ? std::string((const char *) op.args[0].as_ptr())
+                                          : "a non-integer operand";
+                throw std::runtime_error("Jump in function '" + func_name + "' expects a @label, got: " + operand);
             }
         }
     }
@@ -420,54 +628,284 @@ private:
         }
     }
 
+    void verify_function_refs() {
+        for (const auto &[func_name, func]: program.functions) {
+            for (const auto &op: func.ops) {
+                if (op.type != OpType::FnRef) continue;
+                if (!op.args[0].has_flag(WordFlag::String)) {
+                    throw std::runtime_error("fnref in function '" + func_name + "' expects a function name");
+                }
+
+                std::string target = (const char *) op.args[0].as_ptr();
+                if (!program.functions.contains(target)) {
+                    throw std::runtime_error("Undefined function '" + target + "' referenced by fnref in function '" +
+                                             func_name + "'");
+                }
+            }
+        }
+    }
+
+    static bool is_jump_op(OpType type) {
+        return type == OpType::Jmp || type == OpType::Je || type == OpType::Jne;
+    }
+
+    // leaf = calls no other CAS function and does not touch its own locals
+    static bool is_leaf(const Function &func) {
+        if (!func.locals.empty()) return false;
+
+        for (const auto &op: func.ops) {
+            switch (op.type) {
+                case OpType::Call:
+                case OpType::CallReg:
+                case OpType::TailCall:
+                case OpType::LocalGet:
+                case OpType::LocalSet: return false;
+                default: break;
+            }
+        }
+        return true;
+    }
+
+    // calls = profiled calls made from the call site
+    bool should_inline(const std::string &name, uint64_t calls) {
+        if (!program.functions.contains(name)) return false;
+        // salloc memory lives until the function returns, inlined it would live as long as the caller
+        if (uses_scratch(program.functions[name])) return false;
+
+        auto attrs = function_attributes.find(name);
+        if (attrs != function_attributes.end()) {
+            if (attrs->second.is_noinline) return false;
+            if (attrs->second.is_inline) return true;
+        }
+
+        if (!auto_inline || name == "main") return false;
+
+        const Function &func = program.functions[name];
+        if (profile) {
+            const FunctionProfile *fp = profile->find(name);
+            // never called in the profiled run, not worth the code size
+            if (!fp || fp->calls == 0) return false;
+            if (profile->is_hot(calls) && func.ops.size() <= hot_inline_threshold && !uses_locals(func) &&
+                !tail_calls(func)) {
+                return true;
+            }
+        }
+        return is_leaf(func) && func.ops.size() <= inline_threshold;
+    }
+
+    static bool uses_locals(const Function &func) {
+        if (!func.locals.empty()) return true;
+        for (const auto &op: func.ops) {
+            if (op.type == OpType::LocalGet || op.type == OpType::LocalSet || op.type == OpType::CallReg) return true;
+        }
+        return false;
+    }
+
+    // inlined, a tail call turns into a call that grows the stack, so the hot path leaves such callees alone
+    static bool tail_calls(const Function &func) {
+        return std::any_of(func.ops.begin(), func.ops.end(), [](const Op &op) {
+            return op.type == OpType::TailCall || op.type == OpType::TailCallQ;
+        });
+    }
+
+    static bool uses_scratch(const Function &func) {
+        return std::any_of(func.ops.begin(), func.ops.end(), [](const Op &op) { return op.type == OpType::SAlloc; });
+    }
+
+    // hot blocks fall through, see cir_opt::layout_hot_blocks
+    void layout_blocks() {
+        site_calls.clear();
+        for (auto &[name, func]: program.functions) {
+            const FunctionProfile *fp = profile->find(name);
+            if (!fp || fp->op_count() != func.ops.size()) continue;
+
+            std::vector<size_t> origin;
+            std::vector<uint64_t> &calls = site_calls[name];
+            calls = fp->site_calls;
+            if (!cir_opt::layout_hot_blocks(func, *fp, &origin)) continue;
+            calls.assign(origin.size(), 0);
+            for (size_t i = 0; i < origin.size(); i++) {
+                if (origin[i] != cir_opt::NONE) calls[i] = fp->site_calls[origin[i]];
+            }
+        }
+    }
+
+    // most called functions first in the bytecode, so they end up next to each other once loaded
+    void order_functions() {
+        std::vector<std::string> names;
+        for (const auto &[name, func]: program.functions) names.push_back(name);
+
+        auto calls = [&](const std::string &name) {
+            const FunctionProfile *fp = profile->find(name);
+            return fp ? fp->calls : 0;
+        };
+        std::sort(names.begin(), names.end(), [&](const std::string &a, const std::string &b) {
+            return calls(a) != calls(b) ? calls(a) > calls(b) : a < b;
+        });
+        program.function_order = names;
+    }
+
+    void run_passes() {
+        verify_functions();
+        verify_labels();
+        verify_jumps();
+        if (instrumented) {
+            verify_function_refs();
+            return;
+        }
+
+        if (profile) layout_blocks();
+        inline_functions();
+        verify_function_refs();
+        if (optimize) run_optimizer();
+        if (tail_call_elimination) eliminate_tail_calls();
+        if (profile) order_functions();
+    }
+
+    // appends the body of callee to ops, its returns become jumps to the op following the body. A tail call
+    // would leave the caller, so it becomes a call followed by the same jump.
+    static void splice_body(std::vector<Op> &ops, const std::vector<Op> &body) {
+        size_t body_start = ops.size();
+        size_t body_len = body.size();
+        if (body_len > 0 && body.back().type == OpType::Ret) body_len--; // falls through instead
+
+        // where each op of the body lands, tail calls take two slots
+        std::vector<size_t> placed(body_len + 1);
+        for (size_t i = 0; i < body_len; i++) {
+            placed[i + 1] = placed[i] + (body[i].type == OpType::TailCall ? 2 : 1);
+        }
+        size_t continuation = body_start + placed[body_len];
+        auto jump_to_continuation = [&] {
+            return Op{OpType::Jmp, {Word::from_int(static_cast<int64_t>(continuation) - 1), Word::from_null(),
+                                    Word::from_null()}};
+        };
+
+        for (size_t i = 0; i < body_len; i++) {
+            Op op = body[i];
+
+            if (op.type == OpType::Ret) {
+                op = jump_to_continuation();
+            } else if (op.type == OpType::TailCall) {
+                op.type = OpType::Call;
+                ops.push_back(op);
+                op = jump_to_continuation();
+            } else if (is_jump_op(op.type)) {
+                // jump targets are stored as target - 1
+                int64_t target = op.args[0].as_int() + 1;
+                int64_t relocated = target >= 0 && static_cast<size_t>(target) < body_len
+                                        ? static_cast<int64_t>(body_start + placed[target])
+                                        : static_cast<int64_t>(continuation);
+                op.args[0] = Word::from_int(relocated - 1);
+            }
+
+            ops.push_back(op);
+        }
+    }
+
+    // inlines calls inside name, callees are expanded first so nested inlining works bottom-up
+    void expand_function(const std::string &name, std::unordered_set<std::string> &done,
+                         std::unordered_set<std::string> &in_progress) {
+        if (done.contains(name)) return;
+        in_progress.insert(name);
+
+        Function &func = program.functions[name];
+        auto calls = site_calls.find(name);
+        std::vector<Op> new_ops;
+        std::vector<size_t> new_index(func.ops.size() + 1);
+        std::vector<size_t> own_jumps;
+
+        for (size_t i = 0; i < func.ops.size(); i++) {
+            const Op &op = func.ops[i];
+            new_index[i] = new_ops.size();
+
+            if (op.type == OpType::Call && op.args[0].has_flag(WordFlag::String)) {
+                std::string callee = (const char *) op.args[0].as_ptr();
+
+                // recursive calls stay calls
+                uint64_t site = calls != site_calls.end() && i < calls->second.size() ? calls->second[i] : 0;
+                if (!in_progress.contains(callee) && should_inline(callee, site)) {
+                    expand_function(callee, done, in_progress);
+                    splice_body(new_ops, program.functions[callee].ops);
+                    continue;
+                }
+            }
+
+            if (is_jump_op(op.type)) own_jumps.push_back(new_ops.size());
+            new_ops.push_back(op);
+        }
+        new_index[func.ops.size()] = new_ops.size();
+
+        for (size_t idx: own_jumps) {
+            Op &op = new_ops[idx];
+            int64_t target = op.args[0].as_int() + 1;
+            if (target >= 0 && static_cast<size_t>(target) < new_index.size()) {
+                op.args[0] = Word::from_int(static_cast<int64_t>(new_index[target]) - 1);
+            }
+        }
+
+        func.ops = std::move(new_ops);
+        in_progress.erase(name);
+        done.insert(name);
+    }
+
     void inline_functions() {
-        std::unordered_set<std::string> used_inline_functions;
+        std::unordered_set<std::string> done;
+        std::unordered_set<std::string> in_progress;
 
-        for (auto &[func_name, func]: program.functions) {
-            std::vector<Op> new_ops;
+        std::vector<std::string> names;
+        for (const auto &[func_name, func]: program.functions) names.push_back(func_name);
+        for (const auto &func_name: names) expand_function(func_name, done, in_progress);
 
+        // functions marked inline are dropped once nothing refers to them anymore
+        std::unordered_set<std::string> referenced;
+        for (const auto &[func_name, func]: program.functions) {
             for (const auto &op: func.ops) {
-                if (op.type == OpType::Call && op.args[0].has_flag(WordFlag::String)) {
-                    std::string called_func = (const char *) op.args[0].as_ptr();
-
-                    if (function_attributes.contains(called_func) &&
-                        function_attributes[called_func].is_inline) {
-                        if (!program.functions.contains(called_func)) {
-                            throw std::runtime_error("Cannot inline undefined function: " + called_func);
-                        }
-
-                        const auto &inline_func = program.functions[called_func];
-
-                        for (const auto &inline_op: inline_func.ops) {
-                            if (inline_op.type == OpType::Ret) {
-                                std::cerr << "[WARNING] Inlined function '" + called_func +
-                                        "' returns from its body! It was removed automatically" << std::endl;
-                                continue;
-                            }
-                            new_ops.push_back(inline_op);
-                        }
-
-                        used_inline_functions.insert(called_func);
-                    } else {
-                        new_ops.push_back(op);
-                    }
-                } else {
-                    new_ops.push_back(op);
+                if ((op.type == OpType::Call || op.type == OpType::TailCall || op.type == OpType::FnRef) &&
+                    op.args[0].has_flag(WordFlag::String)) {
+                    referenced.insert((const char *) op.args[0].as_ptr());
                 }
             }
-
-            func.ops = new_ops;
         }
 
-        std::vector<std::string> functions_to_remove;
         for (const auto &[func_name, attrs]: function_attributes) {
-            if (attrs.is_inline) {
-                functions_to_remove.push_back(func_name);
+            if (attrs.is_inline && func_name != "main" && !referenced.contains(func_name)) {
+                program.functions.erase(func_name);
             }
         }
+    }
 
-        for (const auto &func_name: functions_to_remove) {
-            program.functions.erase(func_name);
+    // true if execution starting at idx returns without doing anything else
+    static bool returns_at(const std::vector<Op> &ops, size_t idx) {
+        for (size_t steps = 0; steps <= ops.size(); steps++) {
+            if (idx >= ops.size()) return true;
+
+            switch (ops[idx].type) {
+                case OpType::Ret: return true;
+                case OpType::Nop: idx++;
+                    break;
+                // jump targets are stored as target - 1
+                case OpType::Jmp: idx = static_cast<size_t>(ops[idx].args[0].as_int() + 1);
+                    break;
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    void run_optimizer() {
+        cir_opt::Optimizer optimizer(program);
+        optimizer.run();
+        register_report = std::move(optimizer.register_report);
+        type_report = std::move(optimizer.type_report);
+    }
+
+    void eliminate_tail_calls() {
+        for (auto &[func_name, func]: program.functions) {
+            for (size_t i = 0; i < func.ops.size(); i++) {
+                if (func.ops[i].type == OpType::Call && returns_at(func.ops, i + 1)) {
+                    func.ops[i].type = OpType::TailCall;
+                }
+            }
         }
     }
 
@@ -481,6 +919,8 @@ private:
 
             if (lower_attr == "inline") {
                 attrs.is_inline = true;
+            } else if (lower_attr == "noinline") {
+                attrs.is_noinline = true;
             } else {
                 throw std::runtime_error("Unknown function attribute: " + attr);
             }
@@ -579,9 +1019,7 @@ public:
 
         file.close();
 
-        verify_functions();
-        verify_labels();
-        inline_functions();
+        run_passes();
     }
 
     void assemble_string(const std::string &source) {
@@ -655,9 +1093,11 @@ public:
             throw std::runtime_error("Missing .end for function: " + current_function);
         }
 
-        verify_functions();
-        verify_labels();
-        inline_functions();
+        run_passes();
+    }
+
+    void load_profile(const std::string &path) {
+        profile = Profile::load(path);
     }
 
     Program get_program() {
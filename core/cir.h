@@ -2,26 +2,45 @@
 #pragma once
 #endif
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <charconv>
 #include <cstdint>
 #include <cstring>
 #include <iomanip>
+#include <memory>
 #include <stack>
 #include <string>
 #include <unordered_map>
+#include <type_traits>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <stdexcept>
 #include <iostream>
 
 #include "config.h"
+#include "helpers/collections.h"
 #include "helpers/heap.h"
-
-class CIR;
+#include "helpers/memops.h"
+#include "helpers/output.h"
+#include "helpers/profile.h"
+#include "helpers/region.h"
+#include "helpers/sdynlib.h"
+#include "helpers/simd.h"
+#include "helpers/stack.h"
+#include "helpers/strings.h"
+
+template<typename Policy>
+class BasicCIR;
+struct DefaultPolicy;
+using CIR = BasicCIR<DefaultPolicy>;
 
 using CIR_ExternFn = void (*)(CIR &vm);
 using CIR_InitLibFn = void (*)(CIR &vm);
+// a function compiled ahead of time by casc, runs in place of the interpreted one
+using CIR_NativeFn = void (*)(CIR &vm);
 
 
 enum class WordType : uint8_t {
@@ -37,11 +56,17 @@ enum class WordFlag : uint16_t {
     String = 1 << 1,
     OwnsMemory = 1 << 2,
     Register = 1 << 3,
+    Bounded = 1 << 4, // fat pointer into a heap allocation, see Word::offset
+    Vector = 1 << 5, // vector register operand
+    Inline = 1 << 6, // string of up to 8 bytes held in data, its length in offset
+    Slice = 1 << 7, // owned string whose data points at a strings::Slice
 };
 
 struct Word {
     WordType type{WordType::Null};
     uint16_t flags = 0;
+    // Bounded pointers: distance from the start of their allocation, lives in what would be padding
+    uint32_t offset = 0;
 
     union {
         int64_t i;
@@ -52,53 +77,36 @@ struct Word {
 
     Word() { data.i = 0; }
 
-    Word(const Word &other) : type(other.type), flags(other.flags) {
-        if (other.has_flag(WordFlag::OwnsMemory) && other.has_flag(WordFlag::String) && other.data.p != nullptr) {
-            const char *src = static_cast<const char *>(other.data.p);
-            size_t len = std::strlen(src);
-            char *str_copy = new char[len + 1];
-            std::strcpy(str_copy, src);
-            data.p = str_copy;
-        } else {
-            data = other.data;
-        }
+    // owned strings are reference counted, copies share the text (see strings::Buffer)
+    Word(const Word &other) : type(other.type), flags(other.flags), offset(other.offset), data(other.data) {
+        if (owns_string()) retain_string();
     }
 
     Word &operator=(const Word &other) {
         if (this != &other) {
-            if (has_flag(WordFlag::OwnsMemory) && has_flag(WordFlag::String) && data.p != nullptr) {
-                delete[] static_cast<char *>(data.p);
-            }
+            if (other.owns_string()) other.retain_string();
+            if (owns_string()) release_string();
 
             type = other.type;
             flags = other.flags;
-
-            if (other.has_flag(WordFlag::OwnsMemory) && other.has_flag(WordFlag::String) && other.data.p != nullptr) {
-                const char *src = static_cast<const char *>(other.data.p);
-                size_t len = std::strlen(src);
-                char *str_copy = new char[len + 1];
-                std::strcpy(str_copy, src);
-                data.p = str_copy;
-            } else {
-                data = other.data;
-            }
+            offset = other.offset;
+            data = other.data;
         }
         return *this;
     }
 
-    Word(Word &&other) noexcept : type(other.type), flags(other.flags), data(other.data) {
+    Word(Word &&other) noexcept : type(other.type), flags(other.flags), offset(other.offset), data(other.data) {
         other.flags = 0;
         other.data.p = nullptr;
     }
 
     Word &operator=(Word &&other) noexcept {
         if (this != &other) {
-            if (has_flag(WordFlag::OwnsMemory) && has_flag(WordFlag::String) && data.p != nullptr) {
-                delete[] static_cast<char *>(data.p);
-            }
+            if (owns_string()) release_string();
 
             type = other.type;
             flags = other.flags;
+            offset = other.offset;
             data = other.data;
 
             other.flags = 0;
@@ -108,11 +116,15 @@ struct Word {
     }
 
     ~Word() {
-        if (has_flag(WordFlag::OwnsMemory) && has_flag(WordFlag::String) && data.p != nullptr) {
-            delete[] static_cast<char *>(data.p);
-        }
+        if (owns_string()) release_string();
     }
 
+    // fits any double in fixed notation
+    using FormatBuffer = std::array<char, 320>;
+
+    // the text print() writes, numbers are formatted into scratch with std::to_chars. Floats get precision decimals.
+    [[nodiscard]] std::string_view format(FormatBuffer &scratch, int precision = 2) const;
+
     void print() const;
 
 
@@ -138,6 +150,14 @@ struct Word {
         return w;
     }
 
+    static Word from_vreg(int64_t val) {
+        Word w;
+        w.type = WordType::Integer;
+        w.data.i = val;
+        w.set_flag(WordFlag::Vector);
+        return w;
+    }
+
     static Word from_ptr(void *val) {
         Word w;
         w.type = WordType::Pointer;
@@ -160,18 +180,40 @@ struct Word {
         return w;
     }
 
-    static Word from_string_owned(const std::string &val) {
+    static Word from_string_owned(std::string_view val) {
         Word w;
         w.type = WordType::Pointer;
         w.set_flag(WordFlag::String);
         w.set_flag(WordFlag::OwnsMemory);
+        w.data.p = const_cast<char *>(strings::create(val));
+        return w;
+    }
 
-        char *str_copy = new char[val.size() + 1];
-        std::strcpy(str_copy, val.c_str());
-        w.data.p = str_copy;
+    // runtime string, short ones are stored inline
+    static Word from_text(std::string_view val) {
+        if (val.size() > sizeof(data)) return from_string_owned(val);
+        Word w;
+        w.type = WordType::Pointer;
+        w.set_flag(WordFlag::String);
+        w.set_flag(WordFlag::Inline);
+        w.offset = static_cast<uint32_t>(val.size());
+        std::memcpy(&w.data, val.data(), val.size());
         return w;
     }
 
+    static Word concat(std::string_view a, std::string_view b) {
+        if (a.size() + b.size() <= sizeof(data)) {
+            char text[sizeof(data)];
+            std::memcpy(text, a.data(), a.size());
+            std::memcpy(text + a.size(), b.data(), b.size());
+            return from_text({text, a.size() + b.size()});
+        }
+        char *text = strings::allocate(a.size() + b.size());
+        std::memcpy(text, a.data(), a.size());
+        std::memcpy(text + a.size(), b.data(), b.size());
+        return adopt_text(text);
+    }
+
     static Word from_null() {
         Word w;
         w.type = WordType::Null;
@@ -187,15 +229,102 @@ struct Word {
     [[nodiscard]] void *as_ptr() const { return data.p; }
     [[nodiscard]] bool as_bool() const { return data.b; }
 
+    [[nodiscard]] bool is_string() const {
+        return type == WordType::Pointer && has_flag(WordFlag::String) && (has_flag(WordFlag::Inline) || data.p);
+    }
+
+    // contents of a string word, is_string() has to hold
+    [[nodiscard]] std::string_view as_string() const {
+        if (has_flag(WordFlag::Inline)) return {reinterpret_cast<const char *>(&data), offset};
+        if (has_flag(WordFlag::OwnsMemory)) {
+            if (has_flag(WordFlag::Slice)) {
+                const auto *slice = static_cast<const strings::Slice *>(data.p);
+                return {slice->chars, slice->length};
+            }
+            return {static_cast<const char *>(data.p), strings::length(static_cast<const char *>(data.p))};
+        }
+        return static_cast<const char *>(data.p);
+    }
+
+    // length bytes from start of a string word, sharing its text unless they fit inline or it is not owned. Shared
+    // slices come from group when one is given.
+    [[nodiscard]] Word substring(size_t start, size_t length, strings::SliceGroup *group = nullptr) const {
+        std::string_view text = as_string().substr(start, length);
+        if (text.size() <= sizeof(data) || !has_flag(WordFlag::OwnsMemory)) return from_text(text);
+
+        const char *root = has_flag(WordFlag::Slice) ? static_cast<const strings::Slice *>(data.p)->root
+                                                      : static_cast<const char *>(data.p);
+        Word w;
+        w.type = WordType::Pointer;
+        w.set_flag(WordFlag::String);
+        w.set_flag(WordFlag::OwnsMemory);
+        w.set_flag(WordFlag::Slice);
+        w.data.p = strings::slice(root, text.data(), text.size(), group);
+        return w;
+    }
+
     constexpr static void expect(Word &w, WordType type, const char *msg) {
         if (w.type != type) {
             throw std::runtime_error("Expected " + std::to_string(static_cast<int>(type)) + " but got " +
                                      std::to_string(static_cast<int>(w.type)) + ": " + msg);
         }
     }
+
+private:
+    [[nodiscard]] bool owns_string() const {
+        return type == WordType::Pointer && has_flag(WordFlag::OwnsMemory) && has_flag(WordFlag::String) && data.p;
+    }
+
+    void retain_string() const {
+        if (has_flag(WordFlag::Slice)) static_cast<strings::Slice *>(data.p)->refs++;
+        else strings::retain(static_cast<const char *>(data.p));
+    }
+
+    void release_string() {
+        if (has_flag(WordFlag::Slice)) strings::release(static_cast<strings::Slice *>(data.p));
+        else strings::release(static_cast<const char *>(data.p));
+    }
+
+    // takes over the reference of a strings::allocate() result
+    static Word adopt_text(const char *text) {
+        Word w;
+        w.type = WordType::Pointer;
+        w.set_flag(WordFlag::String);
+        w.set_flag(WordFlag::OwnsMemory);
+        w.data.p = const_cast<char *>(text);
+        return w;
+    }
+};
+
+// map keys: strings compare by contents, everything else by type and payload
+struct WordHash {
+    uint64_t operator()(const Word &w) const {
+        uint64_t h;
+        if (w.is_string()) {
+            h = 0xcbf29ce484222325; // FNV-1a
+            for (char c: w.as_string()) h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+        } else {
+            h = w.type == WordType::Boolean ? w.as_bool() : static_cast<uint64_t>(w.as_int());
+        }
+
+        // the map probes with the high bits and tags slots with the low ones, mix both
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccd;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53;
+        return h ^ (h >> 33);
+    }
+};
+
+struct WordEq {
+    bool operator()(const Word &a, const Word &b) const {
+        if (a.is_string() || b.is_string()) return a.is_string() && b.is_string() && a.as_string() == b.as_string();
+        if (a.type != b.type) return false;
+        if (a.type == WordType::Boolean) return a.as_bool() == b.as_bool();
+        return a.type == WordType::Null || a.as_int() == b.as_int();
+    }
 };
 
-// TODO: pointer operations (PAdd, PSub)
 enum class OpType : uint8_t {
     Mov,
     Push, // Push value
@@ -240,6 +369,114 @@ enum class OpType : uint8_t {
     LocalSet,
     Alloc,
     Free,
+    FnRef, // load function id into register
+    CallReg, // call function id held in register
+    TailCall, // call that reuses the current call frame
+
+    // type-specialized forms emitted by the optimizer where operand types are proven
+    MovInt, // integer immediate into a register that already holds an integer
+    IAddInt,
+    ISubInt,
+    IMulInt,
+    IncInt,
+    DecInt,
+    I2F, // cast "float" of an integer
+    F2I, // cast "int" of a float
+    P2I, // cast "int" of a pointer
+    I2P, // cast "ptr" of an integer
+
+    // quickened forms, only created by the interpreter while running and turned back into the generic op when
+    // their assumption fails (see generic_op / dequicken)
+    IAddQ, // iadd with an integer already in r0
+    CallQ, // call with the function id resolved into args[2]
+    TailCallQ,
+    CallExternQ, // callx with its extern table entry in args[1] and the extern generation in args[2]
+    CastQ, // cast with the target type decoded into args[2]
+
+    PushN, // push registers args[0]..args[1]
+    PopN, // pop into registers args[1]..args[0], undoing a PushN of the same range
+
+    // typed memory access at [args[1] + index * scale + offset], see MemOperand. Loads write args[0],
+    // stores read args[0]. Integer loads sign-extend, the .u forms zero-extend.
+    LdI8,
+    LdI16,
+    LdI32,
+    LdI64,
+    LdU8,
+    LdU16,
+    LdU32,
+    LdF32,
+    LdF64,
+    StI8,
+    StI16,
+    StI32,
+    StI64,
+    StF32,
+    StF64,
+
+    PAdd, // r0 = args[0] + args[1] bytes
+    PSub, // r0 = args[0] - args[1] bytes
+    PDiff, // r0 = distance in bytes between the pointers in args[0] and args[1]
+
+    RegionNew, // r0 = new arena of args[0] bytes carved from the heap, released with free
+    RegionAlloc, // r0 = args[1] bytes (immediate or register) bumped from the arena in args[0]
+    RegionFreeAll, // releases everything allocated from the arena in args[0]
+
+    SAlloc, // args[1] = args[0] bytes (immediate or register) of scratch memory, released when the function returns
+
+    // growable arrays and hash maps of words living in the VM heap, see HeapArray and SwissMap
+    ArrNew, // r0 = new empty array
+    ArrPush, // append args[1] to the array in args[0]
+    ArrGet, // r0 = element args[1] of the array in args[0]
+    ArrSet, // element args[1] of the array in args[0] = args[2]
+    ArrLen, // r0 = element count of the array in args[0]
+    ArrFree, // releases the array in args[0] and its elements
+    MapNew, // r0 = new empty map
+    MapSet, // key args[1] of the map in args[0] = args[2]
+    MapGet, // r0 = value of key args[1] in the map in args[0], null when missing
+    MapFind, // cmp flag = key args[1] is in the map in args[0]
+    MapDel, // removes key args[1] from the map in args[0], cmp flag = it was there
+    MapLen, // r0 = entry count of the map in args[0]
+    MapFree, // releases the map in args[0] and its entries
+
+    // packed ops on the vector registers (args naming one have WordFlag::Vector), four 64 bit lanes each.
+    // Arithmetic and compares compute args[2] = args[0] op args[1], compares set all bits of the lanes where they
+    // hold.
+    VLoad, // args[0] = 32 bytes at a memory operand, like LdI64
+    VStore, // 32 bytes at a memory operand = args[0], like StI64
+    VMov, // args[1] = args[0]
+    VSplat, // every lane of args[1] = the bits of register args[0]
+    VAddI64,
+    VSubI64,
+    VMulI64,
+    VAddF64,
+    VSubF64,
+    VMulF64,
+    VDivF64,
+    VCmpEqI64,
+    VCmpGtI64,
+    VCmpEqF64,
+    VCmpGtF64,
+    VBlend, // lanes of args[2] = args[1] where the mask in args[0] is set
+    // r0 = horizontal reduction of args[0]
+    VSumI64,
+    VMinI64,
+    VMaxI64,
+    VSumF64,
+    VMinF64,
+    VMaxF64,
+
+    // bulk memory over args[2] bytes (immediate or register), see memops::kernels()
+    MemSet, // fill the memory at args[0] with the byte args[1] (immediate or register)
+    MemCmp, // r0 = -1, 0 or 1 comparing the memory at args[0] with the memory at args[1]
+    MemChr, // r0 = first byte args[1] (immediate or register) in the memory at args[0], null when missing
+    MemMove, // copy the memory at args[1] to args[0], they may overlap
+
+    // immutable strings, see Word::as_string. Results are ref counted and share text instead of copying it.
+    StrLen, // r0 = byte length of the string in args[0]
+    StrConcat, // r0 = the string in args[0] followed by the one in args[1]
+    StrSlice, // r0 = args[2] bytes from byte args[1] (immediates or registers) of the string in args[0]
+    StrEq, // cmp flag = the strings in args[0] and args[1] have the same bytes
 };
 
 struct Op {
@@ -247,37 +484,251 @@ struct Op {
     std::array<Word, Config::OpArgCount> args{};
 };
 
+inline OpType generic_op(OpType type) {
+    switch (type) {
+        case OpType::IAddQ: return OpType::IAdd;
+        case OpType::CallQ: return OpType::Call;
+        case OpType::TailCallQ: return OpType::TailCall;
+        case OpType::CallExternQ: return OpType::CallExtern;
+        case OpType::CastQ: return OpType::Cast;
+        default: return type;
+    }
+}
+
+// drops everything the interpreter cached in an op
+inline void dequicken(Op &op) {
+    op.type = generic_op(op.type);
+    switch (op.type) {
+        case OpType::IAdd:
+        case OpType::Call:
+        case OpType::TailCall:
+        case OpType::Cast: op.args[2] = Word::from_null();
+            break;
+        case OpType::CallExtern:
+        case OpType::CallReg: op.args[1] = Word::from_null();
+            op.args[2] = Word::from_null();
+            break;
+        default: break;
+    }
+}
+
+inline bool is_load(OpType type) { return type >= OpType::LdI8 && type <= OpType::LdF64; }
+inline bool is_store(OpType type) { return type >= OpType::StI8 && type <= OpType::StF64; }
+inline bool is_vector_memory_op(OpType type) { return type == OpType::VLoad || type == OpType::VStore; }
+inline bool is_memory_op(OpType type) { return is_load(type) || is_store(type) || is_vector_memory_op(type); }
+
+// index register, scale and offset of a typed load/store, packed into args[2] so an op keeps three operands
+struct MemOperand {
+    int32_t offset = 0;
+    int16_t index = -1; // register, -1 without one
+    uint8_t scale = 1; // 1, 2, 4 or 8
+
+    [[nodiscard]] int64_t pack() const {
+        return static_cast<int64_t>(static_cast<uint32_t>(offset) |
+                                    static_cast<uint64_t>(static_cast<uint16_t>(index)) << 32 |
+                                    static_cast<uint64_t>(scale) << 48);
+    }
+
+    static MemOperand unpack(int64_t packed) {
+        auto bits = static_cast<uint64_t>(packed);
+        return {static_cast<int32_t>(bits), static_cast<int16_t>(bits >> 32), static_cast<uint8_t>(bits >> 48)};
+    }
+};
+
+// cast targets as decoded into CastQ
+enum class CastTarget : uint8_t { Int, Float, Ptr };
+
 struct Function {
     std::vector<Op> ops{};
     std::unordered_map<Config::DI_TYPE, Word> locals{};
     Config::DI_TYPE co{};
 };
 
+// identifies the ops of a function, natives compiled from other ops are rejected by CIR::set_native_fn
+inline uint64_t function_fingerprint(const Function &fn) {
+    uint64_t hash = 1469598103934665603ULL; // FNV-1a
+    auto mix = [&](const void *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<const uint8_t *>(data)[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    for (const auto &quickened: fn.ops) {
+        Op op = quickened;
+        dequicken(op);
+        mix(&op.type, sizeof(op.type));
+        for (const auto &arg: op.args) {
+            mix(&arg.type, sizeof(arg.type));
+            if (arg.has_flag(WordFlag::String) && arg.type == WordType::Pointer) {
+                if (arg.as_ptr()) mix(arg.as_ptr(), std::strlen(static_cast<const char *>(arg.as_ptr())));
+            } else {
+                mix(&arg.data, sizeof(arg.data));
+            }
+        }
+    }
+    return hash;
+}
+
 struct CallFrame {
-    std::string name{};
-    Config::DI_TYPE co{};
+    Config::DI_TYPE fn{}; // function id
+    Config::DI_TYPE co{}; // return address
+    uint32_t scratch{}; // start of the caller's salloc memory
 };
 
 class Program {
 public:
     std::unordered_map<std::string, Function> functions{};
 
+    // order functions are written to bytecode in, functions not listed follow sorted by name
+    std::vector<std::string> function_order{};
+
     std::vector<std::string> required_externs{};
 
     struct {
-        std::string cf{};
+        Config::DI_TYPE cf{}; // current function id
         bool running = true;
         std::vector<CallFrame> call_stack{};
     } state;
 };
 
-class CIR {
-    std::array<Word, Config::REGISTER_COUNT> registers{};
-    std::vector<Word> stack{};
-    std::unordered_map<std::string, CIR_ExternFn> extern_functions{};
+// how ops are dispatched by the interpreter
+enum class Dispatch : uint8_t {
+    Switch, // every op stays generic
+    Quickening, // ops rewrite themselves into specialized forms while running (see generic_op)
+};
+
+// compile-time configuration of a BasicCIR, features a policy turns off are not compiled into that VM.
+// Custom policies usually derive from DefaultPolicy and override what they need.
+struct DefaultPolicy {
+    static constexpr int REGISTER_COUNT = Config::REGISTER_COUNT;
+    static constexpr int VECTOR_REGISTER_COUNT = Config::VECTOR_REGISTER_COUNT;
+    static constexpr size_t HEAP_SIZE = Config::HEAP_SIZE;
+    static constexpr size_t STACK_SIZE = Config::STACK_SIZE; // in Words
+    static constexpr size_t SCRATCH_SIZE = Config::SCRATCH_SIZE;
+    static constexpr size_t OUTPUT_BUFFER_SIZE = Config::OUTPUT_BUFFER_SIZE;
+
+    // verify programs on load and check every op of programs that fail, without it bytecode is trusted as it is
+    static constexpr bool BOUNDS_CHECKS = true;
+
+    // call trace() before every op
+    static constexpr bool TRACING = false;
+
+    static constexpr Dispatch DISPATCH = Dispatch::Quickening;
+
+    // see Config::FAT_POINTERS
+    static constexpr bool FAT_POINTERS = Config::FAT_POINTERS;
+
+    using HeapType = Heap;
+
+    template<typename VM>
+    static void trace(VM &, const Function &, const Op &) {}
+};
+
+// for trusted hot code: nothing is verified or checked
+struct UncheckedPolicy : DefaultPolicy {
+    static constexpr bool BOUNDS_CHECKS = false;
+};
+
+template<typename Policy>
+class BasicCIR {
+public:
+    using PolicyType = Policy;
+    using ExternFn = void (*)(BasicCIR &vm);
+    using NativeFn = void (*)(BasicCIR &vm);
+    using Array = HeapArray<Word, typename Policy::HeapType>;
+    using Map = SwissMap<Word, Word, WordHash, WordEq, typename Policy::HeapType>;
+
+private:
+    static constexpr bool QUICKEN = Policy::DISPATCH == Dispatch::Quickening;
+
+    std::array<Word, Policy::REGISTER_COUNT> registers{};
+    std::array<simd::Vec256, Policy::VECTOR_REGISTER_COUNT> vregs{};
+    BoundedStack<Word> stack{Policy::STACK_SIZE};
+    struct Extern {
+        ExternFn fn;
+        // std externs print through output(), anything else may write to stdout itself and gets it flushed first
+        bool flush_output;
+    };
+
+    std::unordered_map<std::string, Extern> extern_functions{};
     bool cmp_flag{false};
     Program program;
-    Heap heap{Config::HEAP_SIZE};
+    typename Policy::HeapType heap{Policy::HEAP_SIZE};
+    OutputBuffer output_buffer{Policy::OUTPUT_BUFFER_SIZE};
+
+    // salloc memory: the current function owns [frame_scratch, scratch_top)
+    std::unique_ptr<uint8_t[]> scratch = std::make_unique<uint8_t[]>(Policy::SCRATCH_SIZE);
+    uint32_t scratch_top = 0;
+    uint32_t frame_scratch = 0;
+
+    void push_frame(Config::DI_TYPE return_to) {
+        program.state.call_stack.push_back({program.state.cf, return_to, frame_scratch});
+        frame_scratch = scratch_top;
+    }
+
+    // function id -> function, rebuilt by link_functions() whenever a program is loaded
+    std::vector<Function *> function_table{};
+    std::vector<std::string> function_names{};
+    std::unordered_map<std::string, Config::DI_TYPE> function_ids{};
+
+    // set by verify_program(), verified programs run without per-op checks
+    bool verified = false;
+
+    // bumped whenever an extern is (re)registered, invalidates CallExternQ caches
+    int64_t extern_generation = 0;
+
+    void deoptimize(Op &op);
+
+    void cast(const Op &op, CastTarget target);
+
+    // fat pointers: throws unless size bytes at delta from ptr stay inside its allocation
+    void check_bounds(const Word &ptr, int64_t delta, size_t size) const;
+
+    uint8_t *address(const Op &op, size_t size);
+
+    template<typename T>
+    void load(const Op &op);
+
+    template<typename T>
+    void store(const Op &op);
+
+    void bulk_memory(const Op &op);
+
+    // the collection whose handle is in register r, throws naming op otherwise
+    Array &array_in(int64_t r, const char *op);
+
+    Map &map_in(int64_t r, const char *op);
+
+    // the arena whose handle is in register r, throws naming op otherwise
+    Region *region_in(int64_t r, const char *op);
+
+    // contents of the string in register r, only valid until r changes
+    std::string_view string_in(int64_t r, const char *op);
+
+    void call_extern(const Extern &e) {
+        if (e.flush_output && output_buffer.pending()) output_buffer.flush();
+        e.fn(*this);
+    }
+
+    // runs the current op of fn, all run loops go through here
+    void dispatch(Function &fn) {
+        if constexpr (Policy::TRACING) Policy::trace(*this, fn, fn.ops[fn.co]);
+        execute_op(fn, fn.ops[fn.co]);
+    }
+
+    // counters are recorded while this is set, see set_profile()
+    Profile *profile = nullptr;
+
+    // function id -> native implementation loaded by load_native(), cleared whenever a program is loaded
+    std::vector<NativeFn> native_table{};
+    std::vector<DynLib> native_libs{};
+
+    void run_checked();
+
+    void run_unchecked();
+
+    void run_profiled();
 
 public:
     Word pop();
@@ -288,9 +739,21 @@ public:
 
     Word &getr(uint16_t i);
 
+    simd::Vec256 &getv(uint16_t i) { return vregs[i]; }
+
+    // count Ts at the pointer in register r for externs, checked like an access through that pointer
+    template<typename T>
+    T *buffer(uint16_t r, int64_t count);
+
+    // bytes of heap memory, a pointer like alloc gives so externs can hand out buffers; null when the heap is full
+    Word allocate(size_t bytes);
+
     Word &gets();
 
-    void execute_op(Function &fn, Op op);
+    void execute_op(Function &fn, Op &op);
+
+    // runs the next op of the current function, checking it first unless the program is verified
+    void step();
 
     void execute_function(const std::string &name);
 
@@ -304,64 +767,129 @@ public:
 
     void load_program(Program p);
 
+    void link_functions();
+
+    bool verify_program();
+
+    void verify_op(const Function &fn, size_t index) const;
+
+    [[nodiscard]] bool is_verified() const;
+
+    Config::DI_TYPE function_id(const std::string &name);
+
+    Function &get_function(Config::DI_TYPE id);
+
+    const std::string &function_name(Config::DI_TYPE id);
+
+    void enter_function(Config::DI_TYPE id);
+
+    bool return_from_function();
+
     Program &get_program();
 
-    void set_extern_fn(std::string n, CIR_ExternFn f);
+    const Program &get_program() const;
+
+    // native code support, used by the C++ casc emits
+    Word *register_file();
+
+    bool &compare_flag();
+
+    [[nodiscard]] bool is_running() const;
+
+    void halt();
+
+    // runs function id to completion, natively when possible
+    void invoke(Config::DI_TYPE id);
+
+    // natives release their salloc memory on return themselves
+    [[nodiscard]] uint32_t scratch_mark() const;
+
+    void release_scratch(uint32_t mark);
 
-    std::vector<Word> &get_stack();
+    bool set_native_fn(const std::string &name, uint64_t fingerprint, NativeFn f);
+
+    // loads a module built from casc output, all functions of the program have to match or nothing is replaced
+    bool load_native(const std::string &path);
+
+    void set_extern_fn(std::string n, ExternFn f);
+
+    BoundedStack<Word> &get_stack();
+
+    // externs build arrays and maps here
+    typename Policy::HeapType &get_heap();
+
+    // what the program prints, flushed when execute_function() returns or throws, before calls to externs outside
+    // std and when it fills up
+    OutputBuffer &output();
+
+    // records call, branch and call site counts into profile while executing, nullptr stops recording
+    void set_profile(Profile *p);
 };
 
 #ifdef CIR_IMPLEMENTATION
 
-void Word::print() const {
+std::string_view Word::format(FormatBuffer &scratch, int precision) const {
+    char *first = scratch.data();
+    char *last = scratch.data() + scratch.size();
+    auto upto = [&](const char *end) { return std::string_view(scratch.data(), end - scratch.data()); };
     switch (type) {
         case WordType::Integer:
-            if (has_flag(WordFlag::Register)) std::cout << "r" << as_int();
-            else std::cout << as_int();
-            break;
-        case WordType::Float:
-            std::cout << std::fixed << std::setprecision(2) << as_float();
-            break;
+            if (has_flag(WordFlag::Register)) *first++ = 'r';
+            else if (has_flag(WordFlag::Vector)) *first++ = 'v';
+            return upto(std::to_chars(first, last, as_int()).ptr);
+        case WordType::Float: {
+            auto [end, error] = std::to_chars(first, last, as_float(), std::chars_format::fixed, precision);
+            // more decimals than fit, the shortest form always does
+            if (error != std::errc{}) end = std::to_chars(first, last, as_float()).ptr;
+            return upto(end);
+        }
         case WordType::Pointer:
-            if (has_flag(WordFlag::String)) {
-                std::cout << static_cast<char *>(as_ptr());
-            } else {
-                std::cout << as_ptr();
-            }
-            break;
-        case WordType::Boolean:
-            std::cout << (as_bool() ? "true" : "false");
-            break;
-        case WordType::Null:
-            std::cout << "null";
-            break;
+            if (is_string()) return as_string();
+            if (!as_ptr()) return "0";
+            *first++ = '0';
+            *first++ = 'x';
+            return upto(std::to_chars(first, last, reinterpret_cast<uintptr_t>(as_ptr()), 16).ptr);
+        case WordType::Boolean: return as_bool() ? "true" : "false";
+        case WordType::Null: return "null";
     }
+    return {};
 }
 
-Word CIR::pop() {
-    Word top = stack.back();
-    stack.pop_back();
-    return top;
+void Word::print() const {
+    FormatBuffer scratch;
+    std::cout << format(scratch);
+}
+
+#endif
+
+template<typename Policy>
+Word BasicCIR<Policy>::pop() {
+    return stack.pop();
 }
 
-void CIR::push(const Word &value) {
-    stack.push_back(value);
+template<typename Policy>
+void BasicCIR<Policy>::push(const Word &value) {
+    stack.push(value);
 }
 
-void CIR::move(const Word &w, uint16_t i) {
+template<typename Policy>
+void BasicCIR<Policy>::move(const Word &w, uint16_t i) {
     registers[i] = w;
 }
 
-Word &CIR::getr(uint16_t i) {
+template<typename Policy>
+Word &BasicCIR<Policy>::getr(uint16_t i) {
     return registers[i];
 }
 
-Word &CIR::gets() {
-    return stack.emplace_back();
+template<typename Policy>
+Word &BasicCIR<Policy>::gets() {
+    return stack.emplace();
 }
 
 // TODO: add expect for types
-void CIR::execute_op(Function &fn, Op op) {
+template<typename Policy>
+void BasicCIR<Policy>::execute_op(Function &fn, Op &op) {
     Word &dest = getr(0);
     switch (op.type) {
         case OpType::Mov: {
@@ -391,10 +919,43 @@ void CIR::execute_op(Function &fn, Op op) {
         }
         break;
 
+        // one bounds check for the whole range
+        case OpType::PushN: {
+            int64_t first = op.args[0].as_int(), last = op.args[1].as_int();
+            stack.reserve(last - first + 1);
+            for (int64_t i = first; i <= last; i++) stack.push_unchecked(registers[i]);
+        }
+        break;
+
+        case OpType::PopN: {
+            int64_t first = op.args[0].as_int(), last = op.args[1].as_int();
+            stack.require(last - first + 1);
+            for (int64_t i = last; i >= first; i--) registers[i] = stack.pop_unchecked();
+        }
+        break;
+
         case OpType::IAdd: {
             Word &a = getr(op.args[0].as_int());
             Word &b = getr(op.args[1].as_int());
+            bool int_dest = dest.type == WordType::Integer;
             dest = Word::from_int(a.as_int() + b.as_int());
+
+            // args[2] counts up to 0 after a deoptimization before the op is quickened again
+            if (QUICKEN && int_dest) {
+                if (op.args[2].type == WordType::Integer && op.args[2].data.i < 0) op.args[2].data.i++;
+                else op.type = OpType::IAddQ;
+            }
+        }
+        break;
+
+        case OpType::IAddQ: {
+            if (dest.type != WordType::Integer) {
+                deoptimize(op);
+                execute_op(fn, op);
+                return;
+            }
+            dest.flags = 0;
+            dest.data.i = getr(op.args[0].as_int()).data.i + getr(op.args[1].as_int()).data.i;
         }
         break;
 
@@ -566,108 +1127,101 @@ void CIR::execute_op(Function &fn, Op op) {
         break;
 
         case OpType::Cast: {
+            // the target is a constant, so it is decoded once and the op continues as CastQ
             std::string target_type = (const char *) op.args[0].as_ptr();
-
-            Word &a = getr(op.args[1].as_int());
-            switch (a.type) {
-                case WordType::Integer: {
-                    if (target_type == "int") {
-                        break;
-                    }
-                    if (target_type == "float") {
-                        dest = Word::from_float(static_cast<double>(a.as_int()));
-                    }
-                    if (target_type == "ptr") {
-                        dest = Word::from_ptr((void *) a.as_int());
-                    } else {
-                        throw std::runtime_error("Invalid cast type: " + std::string(target_type));
-                    }
-                }
-                break;
-                case WordType::Float: {
-                    if (target_type == "int") {
-                        dest = Word::from_int(static_cast<int>(a.as_float()));
-                    } else if (target_type == "float") {
-                        break;
-                    } else {
-                        throw std::runtime_error("Invalid cast type: " + std::string(target_type));
-                    }
-                }
-                break;
-                case WordType::Pointer: {
-                    if (target_type == "int") {
-                        dest = Word::from_int((int64_t) a.as_ptr());
-                    } else {
-                        throw std::runtime_error("Invalid cast type: " + std::string(target_type));
-                    }
-                }
-                break;
-                default: assert(0 && "Unsupported word type");
+            CastTarget target;
+            if (target_type == "int") target = CastTarget::Int;
+            else if (target_type == "float") target = CastTarget::Float;
+            else if (target_type == "ptr") target = CastTarget::Ptr;
+            else throw std::runtime_error("Invalid cast type: " + target_type);
+
+            if constexpr (QUICKEN) {
+                op.type = OpType::CastQ;
+                op.args[2] = Word::from_int(static_cast<int64_t>(target));
             }
+            cast(op, target);
         }
         break;
 
+        case OpType::CastQ: cast(op, static_cast<CastTarget>(op.args[2].as_int()));
+            break;
+
         case OpType::Halt: program.state.running = false;
             break;
 
         case OpType::Nop: break;
 
         case OpType::Call: {
-            CallFrame cf = {program.state.cf, fn.co + 1};
-            program.state.call_stack.push_back(cf);
-            program.state.cf = std::string((const char *) op.args[0].as_ptr());
-
-            if (!program.functions.contains(program.state.cf)) {
-                throw std::runtime_error("Function not found: " + program.state.cf);
+            Config::DI_TYPE id = function_id((const char *) op.args[0].as_ptr());
+            if constexpr (QUICKEN) {
+                op.type = OpType::CallQ;
+                op.args[2] = Word::from_int(id);
             }
-            program.functions[program.state.cf].co = 0;
+            push_frame(fn.co + 1);
+            enter_function(id);
         }
             return;
 
-        case OpType::CallExtern: {
-            if (op.args[0].type != WordType::Pointer) {
-                throw std::runtime_error("CallExtern: first argument must be a pointer to function name");
-            }
+        case OpType::CallQ: {
+            push_frame(fn.co + 1);
+            enter_function(op.args[2].as_int());
+        }
+            return;
 
-            const char *fn_name_cstr = static_cast<const char *>(op.args[0].as_ptr());
-            if (fn_name_cstr == nullptr) {
-                throw std::runtime_error("CallExtern: null function name");
+        case OpType::TailCall: {
+            // the caller's frame is reused, so the callee returns straight to our caller
+            Config::DI_TYPE id = function_id((const char *) op.args[0].as_ptr());
+            if constexpr (QUICKEN) {
+                op.type = OpType::TailCallQ;
+                op.args[2] = Word::from_int(id);
             }
+            enter_function(id);
+        }
+            return;
+
+        case OpType::TailCallQ: {
+            enter_function(op.args[2].as_int());
+        }
+            return;
 
-            std::string fn_name(fn_name_cstr);
+        case OpType::CallExtern: {
+            std::string fn_name(static_cast<const char *>(op.args[0].as_ptr()));
 
             auto it = extern_functions.find(fn_name);
             if (it == extern_functions.end()) {
                 throw std::runtime_error("External function not found: " + fn_name);
             }
 
-            it->second(*this);
+            if constexpr (QUICKEN) {
+                op.type = OpType::CallExternQ;
+                op.args[1] = Word::from_ptr(&it->second);
+                op.args[2] = Word::from_int(extern_generation);
+            }
+            call_extern(it->second);
         }
         break;
 
-        case OpType::Ret: {
-            if (program.state.call_stack.empty()) {
-                program.state.running = false;
+        case OpType::CallExternQ: {
+            if (op.args[2].as_int() != extern_generation) {
+                deoptimize(op);
+                execute_op(fn, op);
                 return;
             }
+            call_extern(*static_cast<const Extern *>(op.args[1].as_ptr()));
+        }
+        break;
 
-            CallFrame cf = program.state.call_stack.back();
-            program.state.call_stack.pop_back();
-
-            program.state.cf = cf.name;
-            program.functions[program.state.cf].co = cf.co;
+        case OpType::Ret: {
+            return_from_function();
         }
             return;
 
         case OpType::LocalGet: {
-            Word::expect(op.args[0], WordType::Integer, "expecting local id");
             dest = fn.locals[op.args[0].as_int()];
         }
         break;
 
         case OpType::LocalSet: {
-            Word::expect(op.args[0], WordType::Integer, "expecting local id");
-            Word::expect(op.args[1], WordType::Integer, "expecting register");
             fn.locals[op.args[0].as_int()] = getr(op.args[1].as_int());
         }
         break;
@@ -683,74 +1237,715 @@ void CIR::execute_op(Function &fn, Op op) {
             if (!src) throw std::runtime_error("Load: source pointer is null");
             if (!d) throw std::runtime_error("Load: destionation pointer is null");
 
+            check_bounds(getr(op.args[0].as_int()), 0, op.args[2].as_int());
+            check_bounds(getr(op.args[1].as_int()), 0, op.args[2].as_int());
             memcpy(d, src, op.args[2].as_int());
         }
         break;
 
         case OpType::Store: {
+            check_bounds(getr(op.args[0].as_int()), 0, op.args[2].as_int());
+            check_bounds(getr(op.args[1].as_int()), 0, op.args[2].as_int());
             memcpy(getr(op.args[0].as_int()).as_ptr(), getr(op.args[1].as_int()).as_ptr(), op.args[2].as_int());
         }
         break;
 
         case OpType::Alloc: {
-            dest = Word::from_ptr(heap.allocate(op.args[0].as_int()));
+            dest = allocate(op.args[0].as_int());
         }
         break;
 
         case OpType::Free: {
-            heap.deallocate(getr(op.args[0].as_int()).as_ptr());
+            const Word &ptr = getr(op.args[0].as_int());
+            if constexpr (Policy::FAT_POINTERS) {
+                if (ptr.has_flag(WordFlag::Bounded) && ptr.offset != 0) {
+                    throw std::runtime_error("Free: pointer is not the start of an allocation");
+                }
+            }
+            heap.deallocate(ptr.as_ptr());
         }
         break;
 
-        default: assert(0 && "wtf, this dont should happen.");
-    }
-}
-
-void CIR::execute_function(const std::string &name) {
-    program.state.cf = name;
-    program.state.running = true;
+        case OpType::PAdd:
+        case OpType::PSub: {
+            const Word &a = getr(op.args[0].as_int());
+            int64_t delta = getr(op.args[1].as_int()).as_int();
+            if (op.type == OpType::PSub) delta = -delta;
+
+            Word result = Word::from_ptr(static_cast<uint8_t *>(a.as_ptr()) + delta);
+            if constexpr (Policy::FAT_POINTERS) {
+                // one past the end is allowed, it just can not be accessed
+                if (a.has_flag(WordFlag::Bounded)) {
+                    check_bounds(a, delta, 0);
+                    result.set_flag(WordFlag::Bounded);
+                    result.offset = static_cast<uint32_t>(a.offset + delta);
+                }
+            }
+            dest = std::move(result);
+        }
+        break;
 
-    if (!program.functions.contains(name)) {
-        throw std::runtime_error("Function not found: " + name);
-    }
+        case OpType::RegionNew: {
+            if (!Region::valid_capacity(op.args[0].as_int())) throw std::runtime_error("region.new: invalid capacity");
+            auto capacity = static_cast<size_t>(op.args[0].as_int());
+            void *memory = heap.allocate(sizeof(Region) + capacity);
+            dest = Word::from_ptr(memory ? Region::create(memory, capacity) : nullptr);
+            if constexpr (Policy::FAT_POINTERS) {
+                if (memory) dest.set_flag(WordFlag::Bounded);
+            }
+        }
+        break;
 
-    program.functions[name].co = 0;
+        case OpType::RegionAlloc: {
+            Region *region = region_in(op.args[0].as_int(), "region.alloc");
+            const Word &size = op.args[1].has_flag(WordFlag::Register) ? getr(op.args[1].as_int()) : op.args[1];
+            // not a heap block of its own, so never a fat pointer
+            dest = Word::from_ptr(region->allocate(static_cast<size_t>(size.as_int())));
+        }
+        break;
 
-    while (program.state.running) {
-        Function &fn = program.functions[program.state.cf];
+        case OpType::RegionFreeAll: {
+            Region *region = region_in(op.args[0].as_int(), "region.free_all");
+            region->free_all();
+        }
+        break;
 
-        if (fn.co >= fn.ops.size()) {
-            if (program.state.call_stack.empty()) {
-                program.state.running = false;
-                break;
+        case OpType::SAlloc: {
+            const Word &size = op.args[0].has_flag(WordFlag::Register) ? getr(op.args[0].as_int()) : op.args[0];
+            uint32_t start = (scratch_top + 15) & ~15u;
+            if (size.as_int() < 0 || start > Policy::SCRATCH_SIZE ||
+                static_cast<uint64_t>(size.as_int()) > Policy::SCRATCH_SIZE - start) {
+                throw std::runtime_error("salloc: scratch memory exhausted");
             }
-
-            CallFrame cf = program.state.call_stack.back();
-            program.state.call_stack.pop_back();
-            program.state.cf = cf.name;
-            program.functions[program.state.cf].co = cf.co;
-            continue;
+            scratch_top = start + static_cast<uint32_t>(size.as_int());
+            // raw even with fat pointers, check_bounds() only knows heap blocks
+            move(Word::from_ptr(scratch.get() + start), op.args[1].as_int());
         }
+        break;
 
-        execute_op(fn, fn.ops[fn.co]);
-        fn.co++;
-    }
-}
+        case OpType::ArrNew: dest = Word::from_ptr(Array::create(heap));
+            break;
 
-void CIR::check_externs() {
-    for (const auto &req: program.required_externs) {
-        if (!extern_functions.contains(req)) {
-            throw std::runtime_error("Missing required external function: " + req);
+        case OpType::ArrPush: array_in(op.args[0].as_int(), "arr.push").push(getr(op.args[1].as_int()));
+            break;
+
+        case OpType::ArrGet:
+        case OpType::ArrSet: {
+            const char *name = op.type == OpType::ArrGet ? "arr.get" : "arr.set";
+            int64_t i = getr(op.args[1].as_int()).as_int();
+            Word *item = array_in(op.args[0].as_int(), name).at(i);
+            if (!item) throw std::runtime_error(std::string(name) + ": index " + std::to_string(i) + " out of bounds");
+            if (op.type == OpType::ArrGet) dest = *item;
+            else *item = getr(op.args[2].as_int());
         }
-    }
+        break;
+
+        case OpType::ArrLen: {
+            size_t size = array_in(op.args[0].as_int(), "arr.len").size();
+            dest = Word::from_int(static_cast<int64_t>(size));
+        }
+        break;
+
+        case OpType::ArrFree: Array::destroy(&array_in(op.args[0].as_int(), "arr.free"));
+            break;
+
+        case OpType::MapNew: dest = Word::from_ptr(Map::create(heap));
+            break;
+
+        case OpType::MapSet: {
+            Map &map = map_in(op.args[0].as_int(), "map.set");
+            map.set(getr(op.args[1].as_int()), getr(op.args[2].as_int()));
+        }
+        break;
+
+        case OpType::MapGet: {
+            Word *value = map_in(op.args[0].as_int(), "map.get").find(getr(op.args[1].as_int()));
+            dest = value ? *value : Word::from_null();
+        }
+        break;
+
+        case OpType::MapFind: {
+            Map &map = map_in(op.args[0].as_int(), "map.find");
+            cmp_flag = map.find(getr(op.args[1].as_int())) != nullptr;
+        }
+        break;
+
+        case OpType::MapDel: cmp_flag = map_in(op.args[0].as_int(), "map.del").erase(getr(op.args[1].as_int()));
+            break;
+
+        case OpType::MapLen: {
+            size_t size = map_in(op.args[0].as_int(), "map.len").size();
+            dest = Word::from_int(static_cast<int64_t>(size));
+        }
+        break;
+
+        case OpType::MapFree: Map::destroy(&map_in(op.args[0].as_int(), "map.free"));
+            break;
+
+        case OpType::VLoad: vregs[op.args[0].as_int()] = simd::load(address(op, sizeof(simd::Vec256)));
+            break;
+
+        case OpType::VStore: simd::store(address(op, sizeof(simd::Vec256)), vregs[op.args[0].as_int()]);
+            break;
+
+        case OpType::VMov: vregs[op.args[1].as_int()] = vregs[op.args[0].as_int()];
+            break;
+
+        case OpType::VSplat: vregs[op.args[1].as_int()] = simd::splat(getr(op.args[0].as_int()).as_int());
+            break;
+
+        case OpType::VAddI64:
+        case OpType::VSubI64:
+        case OpType::VMulI64:
+        case OpType::VAddF64:
+        case OpType::VSubF64:
+        case OpType::VMulF64:
+        case OpType::VDivF64:
+        case OpType::VCmpEqI64:
+        case OpType::VCmpGtI64:
+        case OpType::VCmpEqF64:
+        case OpType::VCmpGtF64: {
+            const simd::Vec256 &a = vregs[op.args[0].as_int()];
+            const simd::Vec256 &b = vregs[op.args[1].as_int()];
+            simd::Vec256 &out = vregs[op.args[2].as_int()];
+            switch (op.type) {
+                case OpType::VAddI64: out = simd::add_i64(a, b);
+                    break;
+                case OpType::VSubI64: out = simd::sub_i64(a, b);
+                    break;
+                case OpType::VMulI64: out = simd::mul_i64(a, b);
+                    break;
+                case OpType::VAddF64: out = simd::add_f64(a, b);
+                    break;
+                case OpType::VSubF64: out = simd::sub_f64(a, b);
+                    break;
+                case OpType::VMulF64: out = simd::mul_f64(a, b);
+                    break;
+                case OpType::VDivF64: out = simd::div_f64(a, b);
+                    break;
+                case OpType::VCmpEqI64: out = simd::eq_i64(a, b);
+                    break;
+                case OpType::VCmpGtI64: out = simd::gt_i64(a, b);
+                    break;
+                case OpType::VCmpEqF64: out = simd::eq_f64(a, b);
+                    break;
+                default: out = simd::gt_f64(a, b);
+                    break;
+            }
+        }
+        break;
+
+        case OpType::VBlend: {
+            simd::Vec256 &out = vregs[op.args[2].as_int()];
+            out = simd::blend(vregs[op.args[0].as_int()], vregs[op.args[1].as_int()], out);
+        }
+        break;
+
+        case OpType::VSumI64: dest = Word::from_int(simd::sum_i64(vregs[op.args[0].as_int()]));
+            break;
+        case OpType::VMinI64: dest = Word::from_int(simd::min_i64(vregs[op.args[0].as_int()]));
+            break;
+        case OpType::VMaxI64: dest = Word::from_int(simd::max_i64(vregs[op.args[0].as_int()]));
+            break;
+        case OpType::VSumF64: dest = Word::from_float(simd::sum_f64(vregs[op.args[0].as_int()]));
+            break;
+        case OpType::VMinF64: dest = Word::from_float(simd::min_f64(vregs[op.args[0].as_int()]));
+            break;
+        case OpType::VMaxF64: dest = Word::from_float(simd::max_f64(vregs[op.args[0].as_int()]));
+            break;
+
+        case OpType::MemSet:
+        case OpType::MemCmp:
+        case OpType::MemChr:
+        case OpType::MemMove: bulk_memory(op);
+            break;
+
+        case OpType::StrLen: {
+            size_t length = string_in(op.args[0].as_int(), "str.len").size();
+            dest = Word::from_int(static_cast<int64_t>(length));
+        }
+        break;
+
+        case OpType::StrConcat: {
+            Word result = Word::concat(string_in(op.args[0].as_int(), "str.concat"),
+                                       string_in(op.args[1].as_int(), "str.concat"));
+            dest = std::move(result);
+        }
+        break;
+
+        case OpType::StrSlice: {
+            auto operand = [&](size_t i) {
+                return (op.args[i].has_flag(WordFlag::Register) ? getr(op.args[i].as_int()) : op.args[i]).as_int();
+            };
+            size_t length = string_in(op.args[0].as_int(), "str.slice").size();
+            int64_t start = operand(1), count = operand(2);
+            if (start < 0 || count < 0 || static_cast<uint64_t>(start) > length ||
+                static_cast<uint64_t>(count) > length - start) {
+                throw std::runtime_error("str.slice: " + std::to_string(count) + " bytes at " + std::to_string(start) +
+                                         " out of bounds of a " + std::to_string(length) + " byte string");
+            }
+            Word result = getr(op.args[0].as_int()).substring(start, count);
+            dest = std::move(result);
+        }
+        break;
+
+        case OpType::StrEq:
+            cmp_flag = string_in(op.args[0].as_int(), "str.eq") == string_in(op.args[1].as_int(), "str.eq");
+            break;
+
+        case OpType::PDiff: {
+            auto *a = static_cast<uint8_t *>(getr(op.args[0].as_int()).as_ptr());
+            auto *b = static_cast<uint8_t *>(getr(op.args[1].as_int()).as_ptr());
+            dest = Word::from_int(a - b);
+        }
+        break;
+
+        case OpType::FnRef: {
+            // args[2] is filled with the function id by link_functions()
+            move(op.args[2], op.args[1].as_int());
+        }
+        break;
+
+        case OpType::CallReg: {
+            int64_t id = getr(op.args[0].as_int()).as_int();
+
+            // monomorphic inline cache: args[1] = last seen id, args[2] = its function
+            if (op.args[1].type != WordType::Integer || op.args[1].as_int() != id) {
+                if (id < 0 || static_cast<size_t>(id) >= function_table.size()) {
+                    throw std::runtime_error("CallReg: invalid function reference " + std::to_string(id));
+                }
+                op.args[1] = Word::from_int(id);
+                op.args[2] = Word::from_ptr(function_table[id]);
+            }
+
+            push_frame(fn.co + 1);
+            program.state.cf = id;
+            static_cast<Function *>(op.args[2].as_ptr())->co = 0;
+        }
+            return;
+
+        // the typed forms write the payload directly, the optimizer proved the destination already is an integer
+        case OpType::MovInt: {
+            Word &r = getr(op.args[1].as_int());
+            r.type = WordType::Integer;
+            r.flags = 0;
+            r.data.i = op.args[0].as_int();
+        }
+        break;
+
+        case OpType::IAddInt: {
+            int64_t v = getr(op.args[0].as_int()).data.i + getr(op.args[1].as_int()).data.i;
+            dest.type = WordType::Integer;
+            dest.flags = 0;
+            dest.data.i = v;
+        }
+        break;
+
+        case OpType::ISubInt: {
+            int64_t v = getr(op.args[0].as_int()).data.i - getr(op.args[1].as_int()).data.i;
+            dest.type = WordType::Integer;
+            dest.flags = 0;
+            dest.data.i = v;
+        }
+        break;
+
+        case OpType::IMulInt: {
+            int64_t v = getr(op.args[0].as_int()).data.i * getr(op.args[1].as_int()).data.i;
+            dest.type = WordType::Integer;
+            dest.flags = 0;
+            dest.data.i = v;
+        }
+        break;
+
+        case OpType::IncInt: {
+            Word &r = getr(op.args[0].as_int());
+            r.type = WordType::Integer;
+            r.flags = 0;
+            r.data.i++;
+        }
+        break;
+
+        case OpType::DecInt: {
+            Word &r = getr(op.args[0].as_int());
+            r.type = WordType::Integer;
+            r.flags = 0;
+            r.data.i--;
+        }
+        break;
+
+        case OpType::I2F: {
+            dest = Word::from_float(static_cast<double>(getr(op.args[0].as_int()).as_int()));
+        }
+        break;
+
+        case OpType::F2I: {
+            dest = Word::from_int(static_cast<int64_t>(getr(op.args[0].as_int()).as_float()));
+        }
+        break;
+
+        case OpType::P2I: {
+            dest = Word::from_int((int64_t) getr(op.args[0].as_int()).as_ptr());
+        }
+        break;
+
+        case OpType::I2P: {
+            dest = Word::from_ptr((void *) getr(op.args[0].as_int()).as_int());
+        }
+        break;
+
+        case OpType::LdI8: load<int8_t>(op);
+            break;
+        case OpType::LdI16: load<int16_t>(op);
+            break;
+        case OpType::LdI32: load<int32_t>(op);
+            break;
+        case OpType::LdI64: load<int64_t>(op);
+            break;
+        case OpType::LdU8: load<uint8_t>(op);
+            break;
+        case OpType::LdU16: load<uint16_t>(op);
+            break;
+        case OpType::LdU32: load<uint32_t>(op);
+            break;
+        case OpType::LdF32: load<float>(op);
+            break;
+        case OpType::LdF64: load<double>(op);
+            break;
+        case OpType::StI8: store<int8_t>(op);
+            break;
+        case OpType::StI16: store<int16_t>(op);
+            break;
+        case OpType::StI32: store<int32_t>(op);
+            break;
+        case OpType::StI64: store<int64_t>(op);
+            break;
+        case OpType::StF32: store<float>(op);
+            break;
+        case OpType::StF64: store<double>(op);
+            break;
+
+        default: assert(0 && "wtf, this dont should happen.");
+    }
+
+    // control transfers (call/ret) return early and set co themselves
+    fn.co++;
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::deoptimize(Op &op) {
+    dequicken(op);
+    if (op.type == OpType::IAdd) op.args[2] = Word::from_int(-Config::QUICKEN_BACKOFF);
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::cast(const Op &op, CastTarget target) {
+    Word &dest = getr(0);
+    Word &a = getr(op.args[1].as_int());
+    switch (a.type) {
+        case WordType::Integer:
+            if (target == CastTarget::Float) dest = Word::from_float(static_cast<double>(a.as_int()));
+            else if (target == CastTarget::Ptr) dest = Word::from_ptr((void *) a.as_int());
+            break;
+        case WordType::Float:
+            if (target == CastTarget::Int) dest = Word::from_int(static_cast<int64_t>(a.as_float()));
+            else if (target == CastTarget::Ptr) {
+                throw std::runtime_error("Invalid cast type: " + std::string((const char *) op.args[0].as_ptr()));
+            }
+            break;
+        case WordType::Pointer:
+            if (target != CastTarget::Int) {
+                throw std::runtime_error("Invalid cast type: " + std::string((const char *) op.args[0].as_ptr()));
+            }
+            dest = Word::from_int((int64_t) a.as_ptr());
+            break;
+        default: throw std::runtime_error("Cast: unsupported source type");
+    }
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::check_bounds(const Word &ptr, int64_t delta, size_t size) const {
+    if constexpr (Policy::FAT_POINTERS) {
+        if (!ptr.has_flag(WordFlag::Bounded)) return;
+
+        const auto *base = static_cast<const uint8_t *>(ptr.as_ptr()) - ptr.offset;
+        int64_t at = static_cast<int64_t>(ptr.offset) + delta;
+        int64_t length = static_cast<int64_t>(Policy::HeapType::allocationSize(base));
+        if (at < 0 || at + static_cast<int64_t>(size) > length) {
+            throw std::runtime_error("Out of bounds access: " + std::to_string(size) + " bytes at offset " +
+                                     std::to_string(at) + " of a " + std::to_string(length) + " byte allocation");
+        }
+    }
+}
+
+template<typename Policy>
+template<typename T>
+T *BasicCIR<Policy>::buffer(uint16_t r, int64_t count) {
+    const Word &ptr = getr(r);
+    if (count < 0) throw std::runtime_error("Negative buffer length " + std::to_string(count));
+    if (count > 0 && !ptr.as_ptr()) throw std::runtime_error("Buffer in r" + std::to_string(r) + " is null");
+    check_bounds(ptr, 0, static_cast<size_t>(count) * sizeof(T));
+    return static_cast<T *>(ptr.as_ptr());
+}
+
+template<typename Policy>
+Word BasicCIR<Policy>::allocate(size_t bytes) {
+    Word w = Word::from_ptr(heap.allocate(bytes));
+    if constexpr (Policy::FAT_POINTERS) {
+        if (w.as_ptr()) w.set_flag(WordFlag::Bounded);
+    }
+    return w;
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::bulk_memory(const Op &op) {
+    const char *name = op.type == OpType::MemSet ? "memset" : op.type == OpType::MemCmp ? "memcmp"
+                     : op.type == OpType::MemChr ? "memchr" : "memmove";
+    auto operand = [&](size_t i) -> const Word & {
+        return op.args[i].has_flag(WordFlag::Register) ? getr(op.args[i].as_int()) : op.args[i];
+    };
+
+    int64_t n = operand(2).as_int();
+    if (n < 0) throw std::runtime_error(std::string(name) + ": negative length " + std::to_string(n));
+    auto memory = [&](const Word &ptr) {
+        if (!ptr.as_ptr()) throw std::runtime_error(std::string(name) + " through a null pointer");
+        check_bounds(ptr, 0, static_cast<size_t>(n));
+        return static_cast<uint8_t *>(ptr.as_ptr());
+    };
+
+    const memops::Kernels &kernels = memops::kernels();
+    const Word &a = getr(op.args[0].as_int());
+    switch (op.type) {
+        case OpType::MemSet:
+            if (n) kernels.fill(memory(a), static_cast<uint8_t>(operand(1).as_int()), n);
+            break;
+
+        case OpType::MemCmp: {
+            int result = n ? kernels.compare(memory(a), memory(getr(op.args[1].as_int())), n) : 0;
+            getr(0) = Word::from_int(result);
+        }
+        break;
+
+        case OpType::MemChr: {
+            Word result = Word::from_ptr(nullptr);
+            if (n) {
+                uint8_t *base = memory(a);
+                const uint8_t *hit = kernels.find(base, static_cast<uint8_t>(operand(1).as_int()), n);
+                result = Word::from_ptr(const_cast<uint8_t *>(hit));
+                if constexpr (Policy::FAT_POINTERS) {
+                    if (hit && a.has_flag(WordFlag::Bounded)) {
+                        result.set_flag(WordFlag::Bounded);
+                        result.offset = static_cast<uint32_t>(a.offset + (hit - base));
+                    }
+                }
+            }
+            getr(0) = std::move(result);
+        }
+        break;
+
+        default:
+            if (n) kernels.move(memory(a), memory(getr(op.args[1].as_int())), n);
+            break;
+    }
+}
+
+template<typename Policy>
+typename BasicCIR<Policy>::Array &BasicCIR<Policy>::array_in(int64_t r, const char *op) {
+    const Word &handle = getr(r);
+    Array *array = nullptr;
+    if (handle.type == WordType::Pointer && !handle.is_string()) array = Array::from(heap, handle.as_ptr());
+    if (!array) throw std::runtime_error(std::string(op) + ": r" + std::to_string(r) + " is not an array");
+    return *array;
+}
+
+template<typename Policy>
+Region *BasicCIR<Policy>::region_in(int64_t r, const char *op) {
+    const Word &handle = getr(r);
+    Region *region = nullptr;
+    if (handle.type == WordType::Pointer && !handle.is_string()) region = Region::from(heap, handle.as_ptr());
+    if (!region) throw std::runtime_error(std::string(op) + ": r" + std::to_string(r) + " is not a region");
+    return region;
+}
+
+template<typename Policy>
+std::string_view BasicCIR<Policy>::string_in(int64_t r, const char *op) {
+    const Word &w = getr(r);
+    if (!w.is_string()) throw std::runtime_error(std::string(op) + ": r" + std::to_string(r) + " is not a string");
+    return w.as_string();
+}
+
+template<typename Policy>
+typename BasicCIR<Policy>::Map &BasicCIR<Policy>::map_in(int64_t r, const char *op) {
+    const Word &handle = getr(r);
+    Map *map = nullptr;
+    if (handle.type == WordType::Pointer && !handle.is_string()) map = Map::from(heap, handle.as_ptr());
+    if (!map) throw std::runtime_error(std::string(op) + ": r" + std::to_string(r) + " is not a map");
+    return *map;
+}
+
+template<typename Policy>
+uint8_t *BasicCIR<Policy>::address(const Op &op, size_t size) {
+    const Word &ptr = getr(op.args[1].as_int());
+    auto *base = static_cast<uint8_t *>(ptr.as_ptr());
+    if (!base) throw std::runtime_error("Memory access through a null pointer");
+
+    MemOperand mem = MemOperand::unpack(op.args[2].as_int());
+    int64_t index = mem.index >= 0 ? getr(mem.index).as_int() : 0;
+    int64_t delta = index * mem.scale + mem.offset;
+    check_bounds(ptr, delta, size);
+    return base + delta;
+}
+
+// memcpy, addresses do not have to be aligned
+template<typename Policy>
+template<typename T>
+void BasicCIR<Policy>::load(const Op &op) {
+    T value;
+    std::memcpy(&value, address(op, sizeof(T)), sizeof(T));
+    if constexpr (std::is_floating_point_v<T>) getr(op.args[0].as_int()) = Word::from_float(value);
+    else getr(op.args[0].as_int()) = Word::from_int(static_cast<int64_t>(value));
+}
+
+template<typename Policy>
+template<typename T>
+void BasicCIR<Policy>::store(const Op &op) {
+    const Word &w = getr(op.args[0].as_int());
+    T value;
+    if constexpr (std::is_floating_point_v<T>) value = static_cast<T>(w.as_float());
+    else value = static_cast<T>(w.as_int());
+    std::memcpy(address(op, sizeof(T)), &value, sizeof(T));
 }
 
-void CIR::execute_program() {
+template<typename Policy>
+void BasicCIR<Policy>::step() {
+    Function &fn = *function_table[program.state.cf];
+
+    if (fn.co >= fn.ops.size()) {
+        return_from_function();
+        return;
+    }
+
+    if constexpr (Policy::BOUNDS_CHECKS) {
+        if (!verified) verify_op(fn, fn.co);
+    }
+    dispatch(fn);
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::run_checked() {
+    while (program.state.running) {
+        Function &fn = *function_table[program.state.cf];
+
+        if (fn.co >= fn.ops.size()) {
+            return_from_function();
+            continue;
+        }
+
+        verify_op(fn, fn.co);
+        dispatch(fn);
+    }
+}
+
+// every op was proven valid by verify_program(), so operands are used as they are
+template<typename Policy>
+void BasicCIR<Policy>::run_unchecked() {
+    while (program.state.running) {
+        Function &fn = *function_table[program.state.cf];
+
+        if (fn.co >= fn.ops.size()) {
+            return_from_function();
+            continue;
+        }
+
+        dispatch(fn);
+    }
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::run_profiled() {
+    std::vector<FunctionProfile *> counters;
+    for (size_t id = 0; id < function_table.size(); id++) {
+        FunctionProfile &fp = profile->functions[function_names[id]];
+        if (fp.op_count() != function_table[id]->ops.size()) {
+            fp = FunctionProfile{};
+            fp.resize(function_table[id]->ops.size());
+        }
+        counters.push_back(&fp);
+    }
+    counters[program.state.cf]->calls++;
+
+    while (program.state.running) {
+        Function &fn = *function_table[program.state.cf];
+
+        if (fn.co >= fn.ops.size()) {
+            return_from_function();
+            continue;
+        }
+
+        if constexpr (Policy::BOUNDS_CHECKS) {
+            if (!verified) verify_op(fn, fn.co);
+        }
+
+        FunctionProfile &counter = *counters[program.state.cf];
+        Config::DI_TYPE at = fn.co;
+        Op &op = fn.ops[at];
+
+        switch (generic_op(op.type)) {
+            case OpType::Je: (cmp_flag ? counter.taken : counter.not_taken)[at]++;
+                break;
+            case OpType::Jne: (cmp_flag ? counter.not_taken : counter.taken)[at]++;
+                break;
+            case OpType::Call:
+            case OpType::TailCall:
+            case OpType::CallReg:
+                counter.site_calls[at]++;
+                dispatch(fn);
+                counters[program.state.cf]->calls++;
+                continue;
+            default: break;
+        }
+
+        dispatch(fn);
+    }
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::execute_function(const std::string &name) {
+    if (!verified) verify_program();
+    program.state.running = true;
+    scratch_top = frame_scratch = 0;
+    enter_function(function_id(name));
+
+    try {
+        if (native_table[program.state.cf]) {
+            native_table[program.state.cf](*this);
+            program.state.running = false;
+        } else if (profile) run_profiled();
+        else if (!Policy::BOUNDS_CHECKS || verified) run_unchecked();
+        else run_checked();
+    } catch (...) {
+        output_buffer.flush();
+        throw;
+    }
+    output_buffer.flush();
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::check_externs() {
+    for (const auto &req: program.required_externs) {
+        if (!extern_functions.contains(req)) {
+            throw std::runtime_error("Missing required external function: " + req);
+        }
+    }
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::execute_program() {
     check_externs();
     execute_function("main");
 }
 
-std::vector<uint8_t> CIR::to_bytecode() {
+template<typename Policy>
+std::vector<uint8_t> BasicCIR<Policy>::to_bytecode() {
     std::vector<uint8_t> bytes;
 
     std::unordered_map<std::string, uint32_t> string_table;
@@ -780,10 +1975,9 @@ std::vector<uint8_t> CIR::to_bytecode() {
             }
         }
 
+        // locals are written while running and may hold inline strings or slices
         for (const auto &[local_id, local_val]: func.locals) {
-            if (local_val.has_flag(WordFlag::String) && local_val.type == WordType::Pointer) {
-                add_string(static_cast<const char *>(local_val.data.p));
-            }
+            if (local_val.is_string()) add_string(std::string(local_val.as_string()).c_str());
         }
     }
 
@@ -819,7 +2013,21 @@ std::vector<uint8_t> CIR::to_bytecode() {
     bytes.insert(bytes.end(), reinterpret_cast<uint8_t *>(&func_count),
                  reinterpret_cast<uint8_t *>(&func_count) + sizeof(func_count));
 
+    // function_order first (hot functions when laid out from a profile), then the rest
+    std::vector<std::string> order;
+    std::unordered_set<std::string> ordered;
+    for (const auto &name: program.function_order) {
+        if (program.functions.contains(name) && ordered.insert(name).second) order.push_back(name);
+    }
+    std::vector<std::string> rest;
     for (const auto &[name, func]: program.functions) {
+        if (!ordered.contains(name)) rest.push_back(name);
+    }
+    std::sort(rest.begin(), rest.end());
+    order.insert(order.end(), rest.begin(), rest.end());
+
+    for (const auto &name: order) {
+        const Function &func = program.functions.at(name);
         uint32_t name_idx = string_table[name];
         bytes.insert(bytes.end(), reinterpret_cast<uint8_t *>(&name_idx),
                      reinterpret_cast<uint8_t *>(&name_idx) + sizeof(name_idx));
@@ -828,7 +2036,9 @@ std::vector<uint8_t> CIR::to_bytecode() {
         bytes.insert(bytes.end(), reinterpret_cast<uint8_t *>(&op_count),
                      reinterpret_cast<uint8_t *>(&op_count) + sizeof(op_count));
 
-        for (const auto &op: func.ops) {
+        for (const auto &quickened: func.ops) {
+            Op op = quickened;
+            dequicken(op);
             bytes.push_back(static_cast<uint8_t>(op.type));
 
             for (size_t i = 0; i < Config::OpArgCount; i++) {
@@ -861,8 +2071,8 @@ std::vector<uint8_t> CIR::to_bytecode() {
             bytes.push_back(local_val.flags);
 
             if (local_val.has_flag(WordFlag::String) && local_val.type == WordType::Pointer) {
-                const char *str = static_cast<const char *>(local_val.data.p);
-                uint32_t str_idx = str ? string_table[std::string(str)] : UINT32_MAX;
+                uint32_t str_idx = local_val.is_string() ? string_table[std::string(local_val.as_string())]
+                                                         : UINT32_MAX;
 
                 bytes.insert(bytes.end(),
                              reinterpret_cast<uint8_t *>(&str_idx),
@@ -878,7 +2088,8 @@ std::vector<uint8_t> CIR::to_bytecode() {
     return bytes;
 }
 
-void CIR::from_bytecode(const std::vector<uint8_t> &bytes) {
+template<typename Policy>
+void BasicCIR<Policy>::from_bytecode(const std::vector<uint8_t> &bytes) {
     size_t offset = 0;
     program = Program{};
 
@@ -999,12 +2210,7 @@ void CIR::from_bytecode(const std::vector<uint8_t> &bytes) {
                             throw std::runtime_error("Invalid string table index");
                         }
 
-                        const std::string &str = string_table[str_idx];
-                        char *str_copy = new char[str.size() + 1];
-                        std::strcpy(str_copy, str.c_str());
-
-                        op.args[i].data.p = str_copy;
-                        op.args[i].set_flag(WordFlag::OwnsMemory);
+                        op.args[i] = Word::from_string_owned(string_table[str_idx]);
                     }
                 } else {
                     if (offset + sizeof(op.args[i].data) > bytes.size()) {
@@ -1060,12 +2266,7 @@ void CIR::from_bytecode(const std::vector<uint8_t> &bytes) {
                         throw std::runtime_error("Invalid string table index");
                     }
 
-                    const std::string &str = string_table[str_idx];
-                    char *str_copy = new char[str.size() + 1];
-                    std::strcpy(str_copy, str.c_str());
-
-                    local_val.data.p = str_copy;
-                    local_val.set_flag(WordFlag::OwnsMemory);
+                    local_val = Word::from_string_owned(string_table[str_idx]);
                 }
             } else {
                 if (offset + sizeof(Word::data) > bytes.size()) {
@@ -1080,23 +2281,564 @@ void CIR::from_bytecode(const std::vector<uint8_t> &bytes) {
         }
 
         program.functions[func_name] = func;
+        program.function_order.push_back(func_name);
     }
+
+    link_functions();
+    verify_program();
 }
 
-void CIR::load_program(Program p) {
+template<typename Policy>
+void BasicCIR<Policy>::load_program(Program p) {
     program = std::move(p);
+    link_functions();
+    verify_program();
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::link_functions() {
+    function_table.clear();
+    function_names.clear();
+    function_ids.clear();
+
+    for (const auto &[name, func]: program.functions) {
+        function_names.push_back(name);
+    }
+    // sorted so ids do not depend on hash map iteration order
+    std::sort(function_names.begin(), function_names.end());
+
+    for (size_t id = 0; id < function_names.size(); id++) {
+        function_table.push_back(&program.functions[function_names[id]]);
+        function_ids[function_names[id]] = id;
+    }
+    native_table.assign(function_table.size(), nullptr);
+
+    for (Function *func: function_table) {
+        for (auto &op: func->ops) {
+            // ids and caches from an earlier run are meaningless now
+            dequicken(op);
+            // linking runs before verification, a malformed operand is left for verify_program() to reject
+            if (op.type == OpType::FnRef) {
+                auto it = op.args[0].is_string() ? function_ids.find(std::string(op.args[0].as_string()))
+                                                 : function_ids.end();
+                op.args[2] = it != function_ids.end() ? Word::from_int(it->second) : Word::from_null();
+            }
+        }
+    }
+}
+
+// proves once that no op can index registers out of bounds, jump outside its function or call a missing
+// function. Invalid programs still run, but every op is checked right before it executes.
+template<typename Policy>
+bool BasicCIR<Policy>::verify_program() {
+    if constexpr (!Policy::BOUNDS_CHECKS) {
+        verified = true;
+        return true;
+    }
+
+    verified = false;
+    try {
+        for (const Function *func: function_table) {
+            for (size_t i = 0; i < func->ops.size(); i++) verify_op(*func, i);
+        }
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    verified = true;
+    return true;
 }
 
-Program &CIR::get_program() {
+template<typename Policy>
+void BasicCIR<Policy>::verify_op(const Function &fn, size_t index) const {
+    const Op &op = fn.ops[index];
+
+    auto fail = [&](const std::string &msg) {
+        throw std::runtime_error("Invalid op " + std::to_string(index) + " (type " +
+                                 std::to_string(static_cast<int>(op.type)) + "): " + msg);
+    };
+    auto integer = [&](size_t i) {
+        if (op.args[i].type != WordType::Integer) fail("operand " + std::to_string(i) + " must be an integer");
+    };
+    auto reg = [&](size_t i) {
+        integer(i);
+        if (op.args[i].as_int() < 0 || op.args[i].as_int() >= Policy::REGISTER_COUNT) {
+            fail("register r" + std::to_string(op.args[i].as_int()) + " out of range");
+        }
+    };
+    auto vreg = [&](size_t i) {
+        integer(i);
+        if (!op.args[i].has_flag(WordFlag::Vector)) fail("operand " + std::to_string(i) + " must be a vector register");
+        if (op.args[i].as_int() < 0 || op.args[i].as_int() >= Policy::VECTOR_REGISTER_COUNT) {
+            fail("vector register v" + std::to_string(op.args[i].as_int()) + " out of range");
+        }
+    };
+    auto name = [&](size_t i) -> const char * {
+        const Word &a = op.args[i];
+        if (a.type != WordType::Pointer || !a.has_flag(WordFlag::String) || a.as_ptr() == nullptr) {
+            fail("operand " + std::to_string(i) + " must be a name");
+        }
+        return static_cast<const char *>(a.as_ptr());
+    };
+    auto function = [&](size_t i) {
+        std::string target = name(i);
+        if (!function_ids.contains(target)) fail("function not found: " + target);
+    };
+
+    // CallReg and CallExternQ keep their inline cache in args[1] and args[2]
+    size_t plain_args = op.type == OpType::CallReg || op.type == OpType::CallExternQ ? 1 : Config::OpArgCount;
+    for (size_t i = 0; i < plain_args; i++) {
+        const Word &a = op.args[i];
+        if (a.type > WordType::Null) fail("operand " + std::to_string(i) + " has an invalid type");
+        // only names may be pointers, anything else would be a raw address from the bytecode
+        if (a.type == WordType::Pointer && !a.has_flag(WordFlag::String)) {
+            fail("operand " + std::to_string(i) + " is a raw pointer");
+        }
+    }
+
+    switch (op.type) {
+        case OpType::Mov:
+            if (op.args[0].has_flag(WordFlag::Register)) reg(0);
+            reg(1);
+            break;
+
+        case OpType::CallQ:
+        case OpType::TailCallQ: {
+            // runs for every quickened call in unverified programs, so the cached id is checked against the name
+            // it was resolved from instead of looking the name up again
+            integer(2);
+            int64_t id = op.args[2].as_int();
+            if (id < 0 || static_cast<size_t>(id) >= function_table.size()) fail("function id out of range");
+            if (function_names[id] != name(0)) fail("stale function id");
+        }
+        break;
+
+        case OpType::CallExternQ: {
+            std::string target = name(0);
+            if (op.args[2].type != WordType::Integer) fail("operand 2 must be an integer");
+            if (op.args[2].as_int() == extern_generation) {
+                auto it = extern_functions.find(target);
+                if (it == extern_functions.end() || &it->second != op.args[1].as_ptr()) {
+                    fail("stale extern cache");
+                }
+            }
+        }
+        break;
+
+        case OpType::CastQ: {
+            name(0);
+            reg(1);
+            integer(2);
+            if (op.args[2].as_int() < 0 || op.args[2].as_int() > static_cast<int64_t>(CastTarget::Ptr)) {
+                fail("invalid cast target");
+            }
+        }
+        break;
+
+        case OpType::Push:
+        case OpType::Ret:
+        case OpType::Halt:
+        case OpType::Nop: break;
+
+        case OpType::PushReg:
+        case OpType::Pop:
+        case OpType::Not:
+        case OpType::Inc:
+        case OpType::Dec:
+        case OpType::Neg:
+        case OpType::Free:
+        case OpType::CallReg:
+        case OpType::IncInt:
+        case OpType::DecInt:
+        case OpType::I2F:
+        case OpType::F2I:
+        case OpType::P2I:
+        case OpType::I2P: reg(0);
+            break;
+
+        case OpType::MovInt: integer(0);
+            reg(1);
+            break;
+
+        case OpType::IAdd:
+        case OpType::ISub:
+        case OpType::IMul:
+        case OpType::IDiv:
+        case OpType::IMod:
+        case OpType::IAnd:
+        case OpType::IOr:
+        case OpType::IXor:
+        case OpType::Shl:
+        case OpType::Shr:
+        case OpType::ICmp:
+        case OpType::Gt:
+        case OpType::Lt:
+        case OpType::Gte:
+        case OpType::Lte:
+        case OpType::FAdd:
+        case OpType::FSub:
+        case OpType::FMul:
+        case OpType::FDiv:
+        case OpType::FCmp:
+        case OpType::IAddQ:
+        case OpType::IAddInt:
+        case OpType::ISubInt:
+        case OpType::IMulInt:
+        case OpType::PAdd:
+        case OpType::PSub:
+        case OpType::PDiff: reg(0);
+            reg(1);
+            break;
+
+        case OpType::Load:
+        case OpType::Store: reg(0);
+            reg(1);
+            integer(2);
+            break;
+
+        case OpType::Jmp:
+        case OpType::Je:
+        case OpType::Jne: {
+            integer(0);
+            // targets are stored minus one, a jump to ops.size() falls off the end and returns
+            int64_t target = op.args[0].as_int() + 1;
+            if (target < 0 || target > static_cast<int64_t>(fn.ops.size())) {
+                fail("jump target " + std::to_string(target) + " outside of function");
+            }
+        }
+        break;
+
+        case OpType::Call:
+        case OpType::TailCall: function(0);
+            break;
+
+        case OpType::FnRef: function(0);
+            reg(1);
+            break;
+
+        case OpType::CallExtern: name(0);
+            break;
+
+        case OpType::Cast: name(0);
+            reg(1);
+            break;
+
+        case OpType::LocalGet: integer(0);
+            break;
+
+        case OpType::LocalSet: integer(0);
+            reg(1);
+            break;
+
+        case OpType::PushN:
+        case OpType::PopN: reg(0);
+            reg(1);
+            if (op.args[0].as_int() > op.args[1].as_int()) fail("empty register range");
+            break;
+
+        case OpType::LdI8:
+        case OpType::LdI16:
+        case OpType::LdI32:
+        case OpType::LdI64:
+        case OpType::LdU8:
+        case OpType::LdU16:
+        case OpType::LdU32:
+        case OpType::LdF32:
+        case OpType::LdF64:
+        case OpType::StI8:
+        case OpType::StI16:
+        case OpType::StI32:
+        case OpType::StI64:
+        case OpType::StF32:
+        case OpType::StF64:
+        case OpType::VLoad:
+        case OpType::VStore: {
+            if (is_vector_memory_op(op.type)) vreg(0);
+            else reg(0);
+            reg(1);
+            integer(2);
+            MemOperand mem = MemOperand::unpack(op.args[2].as_int());
+            if (mem.index < -1 || mem.index >= Policy::REGISTER_COUNT) {
+                fail("index register r" + std::to_string(mem.index) + " out of range");
+            }
+            if (mem.scale != 1 && mem.scale != 2 && mem.scale != 4 && mem.scale != 8) fail("invalid scale");
+        }
+        break;
+
+        case OpType::Alloc: integer(0);
+            break;
+
+        case OpType::RegionNew: integer(0);
+            if (!Region::valid_capacity(op.args[0].as_int())) fail("invalid region capacity");
+            break;
+
+        case OpType::RegionAlloc: reg(0);
+            if (op.args[1].has_flag(WordFlag::Register)) reg(1);
+            else integer(1);
+            break;
+
+        case OpType::RegionFreeAll: reg(0);
+            break;
+
+        case OpType::SAlloc:
+            if (op.args[0].has_flag(WordFlag::Register)) reg(0);
+            else integer(0);
+            reg(1);
+            break;
+
+        case OpType::ArrNew:
+        case OpType::MapNew: break;
+
+        case OpType::ArrLen:
+        case OpType::ArrFree:
+        case OpType::MapLen:
+        case OpType::MapFree: reg(0);
+            break;
+
+        case OpType::ArrPush:
+        case OpType::ArrGet:
+        case OpType::MapGet:
+        case OpType::MapFind:
+        case OpType::MapDel: reg(0);
+            reg(1);
+            break;
+
+        case OpType::ArrSet:
+        case OpType::MapSet: reg(0);
+            reg(1);
+            reg(2);
+            break;
+
+        case OpType::VMov: vreg(0);
+            vreg(1);
+            break;
+
+        case OpType::MemSet:
+        case OpType::MemCmp:
+        case OpType::MemChr:
+        case OpType::MemMove: reg(0);
+            // memcmp and memmove take a second pointer, memset and memchr a byte
+            if (op.type == OpType::MemCmp || op.type == OpType::MemMove) reg(1);
+            else if (op.args[1].has_flag(WordFlag::Register)) reg(1);
+            else integer(1);
+            if (op.args[2].has_flag(WordFlag::Register)) reg(2);
+            else integer(2);
+            break;
+
+        case OpType::VSplat: reg(0);
+            vreg(1);
+            break;
+
+        case OpType::StrLen: reg(0);
+            break;
+
+        case OpType::StrConcat:
+        case OpType::StrEq: reg(0);
+            reg(1);
+            break;
+
+        case OpType::StrSlice: reg(0);
+            for (size_t i = 1; i <= 2; i++) {
+                if (op.args[i].has_flag(WordFlag::Register)) reg(i);
+                else integer(i);
+            }
+            break;
+
+        case OpType::VAddI64:
+        case OpType::VSubI64:
+        case OpType::VMulI64:
+        case OpType::VAddF64:
+        case OpType::VSubF64:
+        case OpType::VMulF64:
+        case OpType::VDivF64:
+        case OpType::VCmpEqI64:
+        case OpType::VCmpGtI64:
+        case OpType::VCmpEqF64:
+        case OpType::VCmpGtF64:
+        case OpType::VBlend: vreg(0);
+            vreg(1);
+            vreg(2);
+            break;
+
+        case OpType::VSumI64:
+        case OpType::VMinI64:
+        case OpType::VMaxI64:
+        case OpType::VSumF64:
+        case OpType::VMinF64:
+        case OpType::VMaxF64: vreg(0);
+            break;
+
+        default: fail("unknown op type");
+    }
+}
+
+template<typename Policy>
+bool BasicCIR<Policy>::is_verified() const {
+    return verified;
+}
+
+template<typename Policy>
+Config::DI_TYPE BasicCIR<Policy>::function_id(const std::string &name) {
+    auto it = function_ids.find(name);
+    if (it == function_ids.end()) {
+        throw std::runtime_error("Function not found: " + name);
+    }
+    return it->second;
+}
+
+template<typename Policy>
+Function &BasicCIR<Policy>::get_function(Config::DI_TYPE id) {
+    return *function_table[id];
+}
+
+template<typename Policy>
+const std::string &BasicCIR<Policy>::function_name(Config::DI_TYPE id) {
+    return function_names[id];
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::enter_function(Config::DI_TYPE id) {
+    program.state.cf = id;
+    function_table[id]->co = 0;
+}
+
+// pops the current call frame, stops the program when there is nothing to return to
+template<typename Policy>
+bool BasicCIR<Policy>::return_from_function() {
+    // salloc memory of the returning function
+    scratch_top = frame_scratch;
+
+    if (program.state.call_stack.empty()) {
+        program.state.running = false;
+        return false;
+    }
+
+    CallFrame cf = program.state.call_stack.back();
+    program.state.call_stack.pop_back();
+    frame_scratch = cf.scratch;
+
+    program.state.cf = cf.fn;
+    function_table[cf.fn]->co = cf.co;
+    return true;
+}
+
+// the caller may modify the program, so it is verified again before it next runs
+template<typename Policy>
+Program &BasicCIR<Policy>::get_program() {
+    verified = false;
+    return program;
+}
+
+template<typename Policy>
+const Program &BasicCIR<Policy>::get_program() const {
     return program;
 }
 
-void CIR::set_extern_fn(std::string n, CIR_ExternFn f) {
-    extern_functions[n] = f;
+template<typename Policy>
+void BasicCIR<Policy>::set_extern_fn(std::string n, ExternFn f) {
+    bool flush_output = !n.starts_with("std.");
+    extern_functions[std::move(n)] = {f, flush_output};
+    extern_generation++;
 }
 
-std::vector<Word> &CIR::get_stack() {
+template<typename Policy>
+BoundedStack<Word> &BasicCIR<Policy>::get_stack() {
     return stack;
 }
 
+template<typename Policy>
+typename Policy::HeapType &BasicCIR<Policy>::get_heap() {
+    return heap;
+}
+
+template<typename Policy>
+OutputBuffer &BasicCIR<Policy>::output() {
+    return output_buffer;
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::set_profile(Profile *p) {
+    profile = p;
+}
+
+template<typename Policy>
+Word *BasicCIR<Policy>::register_file() {
+    return registers.data();
+}
+
+template<typename Policy>
+bool &BasicCIR<Policy>::compare_flag() {
+    return cmp_flag;
+}
+
+template<typename Policy>
+bool BasicCIR<Policy>::is_running() const {
+    return program.state.running;
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::halt() {
+    program.state.running = false;
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::invoke(Config::DI_TYPE id) {
+    if (id >= function_table.size()) {
+        throw std::runtime_error("CallReg: invalid function reference " + std::to_string(id));
+    }
+    if (!native_table[id]) {
+        throw std::runtime_error("No native code for function: " + function_names[id]);
+    }
+    native_table[id](*this);
+}
+
+template<typename Policy>
+uint32_t BasicCIR<Policy>::scratch_mark() const {
+    return scratch_top;
+}
+
+template<typename Policy>
+void BasicCIR<Policy>::release_scratch(uint32_t mark) {
+    scratch_top = mark;
+}
+
+template<typename Policy>
+bool BasicCIR<Policy>::set_native_fn(const std::string &name, uint64_t fingerprint, NativeFn f) {
+    auto it = function_ids.find(name);
+    if (it == function_ids.end() || function_fingerprint(*function_table[it->second]) != fingerprint) return false;
+    native_table[it->second] = f;
+    return true;
+}
+
+template<typename Policy>
+bool BasicCIR<Policy>::load_native(const std::string &path) {
+    // casc emits modules against CIR
+    if constexpr (!std::is_same_v<BasicCIR, CIR>) return false;
+
+    DynLib lib;
+    if (!lib.load(path)) return false;
+
+    auto init = lib.get<NativeFn>("cir_init_native");
+    if (!init) {
+        lib.unload();
+        return false;
+    }
+    init(*this);
+
+    // natives call each other directly, so a partial match is not usable
+    if (std::find(native_table.begin(), native_table.end(), nullptr) != native_table.end()) {
+        native_table.assign(function_table.size(), nullptr);
+        lib.unload();
+        return false;
+    }
+
+    native_libs.push_back(lib);
+    return true;
+}
+
+
+// CIR itself is compiled once into libcir, other policies are instantiated where they are used
+#ifdef CIR_IMPLEMENTATION
+template class BasicCIR<DefaultPolicy>;
+#else
+extern template class BasicCIR<DefaultPolicy>;
 #endif
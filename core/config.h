@@ -3,11 +3,28 @@
 
 namespace Config {
     constexpr int REGISTER_COUNT = 256; // 256 Words = 2kb memory
-    constexpr int STACK_SIZE = 1024 * 4; // 4kb
+    constexpr int VECTOR_REGISTER_COUNT = 32; // 256 bit each, 1kb
+    constexpr int STACK_SIZE = 1024 * 4; // Words, 64kb
     constexpr int HEAP_SIZE = 1024 * 1024 * 64; // 64 kb
+    constexpr int SCRATCH_SIZE = 1024 * 64; // salloc memory shared by all call frames
+    constexpr int OUTPUT_BUFFER_SIZE = 1024 * 64; // program output is written in chunks of this many bytes
 
     constexpr int OpArgCount = 3;
 
+    // calls between casc natives are C++ calls, deeper nesting throws instead of overflowing the C++ stack
+    constexpr int NATIVE_CALL_DEPTH = 1024 * 16;
+
+    // executions a quickened op has to stay generic after its assumption failed
+    constexpr int QUICKEN_BACKOFF = 64;
+
+    // pointers from alloc remember their allocation and every access through them is bounds checked,
+    // build with -DCIR_FAT_POINTERS for debugging
+#ifdef CIR_FAT_POINTERS
+    constexpr bool FAT_POINTERS = true;
+#else
+    constexpr bool FAT_POINTERS = false;
+#endif
+
     // Default Integer Type
     using DI_TYPE = uint32_t;
 
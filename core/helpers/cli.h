@@ -24,6 +24,12 @@ struct CliConfig {
     bool show_registers = false;
     bool benchmark = false;
     bool disassemble = false;
+    bool optimize = true;
+    bool register_report = false;
+    bool type_report = false;
+    std::string profile_out;
+    std::string profile_in;
+    std::string native;
     int log_level = 1;
     std::vector<DynLib> dls{};
 };
@@ -110,7 +116,12 @@ class CliTool {
             if (!config.verbose) {
                 assembler.show_better_practice = false;
             }
+            assembler.optimize = config.optimize;
+            assembler.instrumented = !config.profile_out.empty();
+            if (!config.profile_in.empty()) assembler.load_profile(config.profile_in);
             assembler.assemble_file(config.input_file);
+            if (config.register_report) print_register_report(assembler.register_report);
+            if (config.type_report) print_type_report(assembler.type_report);
 
             logger.debug("Assembly completed, generating bytecode");
 
@@ -128,6 +139,24 @@ class CliTool {
         }
     }
 
+    static void print_register_report(const std::vector<cir_opt::RegisterPressure> &report) {
+        std::cout << "\nRegister pressure:" << std::endl;
+        for (const auto &p: report) {
+            std::cout << "  " << p.function << ": " << p.registers << " registers, max " << p.max_live << " live";
+            if (p.spills_removed > 0) std::cout << ", " << p.spills_removed << " spills removed";
+            if (p.spills_fused > 0) std::cout << ", " << p.spills_fused << " spill runs fused";
+            if (p.compacted) std::cout << ", compacted";
+            std::cout << std::endl;
+        }
+    }
+
+    static void print_type_report(const std::vector<cir_opt::TypeSite> &report) {
+        std::cout << "\nUnproven types (" << report.size() << " sites):" << std::endl;
+        for (const auto &site: report) {
+            std::cout << "  " << site.function << " [" << site.op << "]: " << site.reason << std::endl;
+        }
+    }
+
     bool load_bytecode() {
         logger.info("Loading bytecode: " + config.output_file);
 
@@ -160,13 +189,21 @@ class CliTool {
         try {
             auto start = std::chrono::high_resolution_clock::now();
 
+            Profile profile;
+            if (!config.profile_out.empty()) cir.set_profile(&profile);
+
             cir_std::init_std(cir);
             cir.execute_program();
+            cir.set_profile(nullptr);
 
             auto end = std::chrono::high_resolution_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 
             logger.success("Program executed successfully");
+            if (!config.profile_out.empty()) {
+                profile.save(config.profile_out);
+                logger.success("Profile written to: " + config.profile_out);
+            }
             if (config.benchmark) {
                 std::cout << "\nExecution time: " << duration.count() << " μs" << std::endl;
             }
@@ -207,6 +244,14 @@ public:
             }
         }
 
+        if (!config.native.empty()) {
+            if (cir.load_native(config.native)) {
+                logger.success("Running native code from: " + config.native);
+            } else {
+                logger.info("Native code in " + config.native + " does not match the program, interpreting");
+            }
+        }
+
         if (!config.skip_run) {
             for (auto &dl: config.dls) {
                 auto init_lib_fn = dl.get<CIR_InitLibFn>("cir_init_lib");
@@ -242,6 +287,12 @@ private:
         std::cout << "  -s, --show-stack         Display stack contents after execution" << std::endl;
         std::cout << "  -g, --show-registers     Display register contents after execution" << std::endl;
         std::cout << "  -b, --benchmark          Show execution time" << std::endl;
+        std::cout << "  -O0, --no-optimize       Skip the optimization passes" << std::endl;
+        std::cout << "  --register-report        Show register pressure per function" << std::endl;
+        std::cout << "  --type-report            Show ops left generic because types are not proven" << std::endl;
+        std::cout << "  --profile-out <file>     Record a runtime profile (builds without optimizations)" << std::endl;
+        std::cout << "  --profile-in <file>      Optimize using a recorded profile" << std::endl;
+        std::cout << "  -n, --native <file>      Run functions compiled by casc from a shared object" << std::endl;
         std::cout << "  -q, --quiet              Suppress all non-error output" << std::endl;
         std::cout << "  -h, --help               Display this help message" << std::endl;
         std::cout << "  --version                Display version information" << std::endl;
@@ -303,6 +354,22 @@ public:
                 config.show_registers = true;
             } else if (arg == "-b" || arg == "--benchmark") {
                 config.benchmark = true;
+            } else if (arg == "-O0" || arg == "--no-optimize") {
+                config.optimize = false;
+            } else if (arg == "--register-report") {
+                config.register_report = true;
+            } else if (arg == "--type-report") {
+                config.type_report = true;
+            } else if (arg == "-n" || arg == "--native") {
+                if (i + 1 >= args.size()) {
+                    throw std::runtime_error("Missing value for " + arg);
+                }
+                config.native = args[++i];
+            } else if (arg == "--profile-out" || arg == "--profile-in") {
+                if (i + 1 >= args.size()) {
+                    throw std::runtime_error("Missing value for " + arg);
+                }
+                (arg == "--profile-out" ? config.profile_out : config.profile_in) = args[++i];
             } else if (arg == "-o" || arg == "--output") {
                 if (i + 1 >= args.size()) {
                     throw std::runtime_error("Missing value for " + arg);
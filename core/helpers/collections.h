@@ -0,0 +1,274 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Collections whose header and storage live in a VM heap, so a handle to one is a plain pointer into it.
+// The heap has to provide allocate(size) (nullptr when full), deallocate(ptr) and contains(ptr, size).
+
+template<typename HeapT>
+void *heap_allocate_or_throw(HeapT &heap, size_t size) {
+    void *p = heap.allocate(size);
+    if (!p) throw std::runtime_error("Out of heap memory");
+    return p;
+}
+
+// growable array, elements are moved when it grows
+template<typename T, typename HeapT>
+class HeapArray {
+    static constexpr uint32_t MAGIC = 0x41525259; // "ARRY"
+
+    uint32_t magic = MAGIC;
+    HeapT *heap;
+    T *items = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    explicit HeapArray(HeapT *heap) : heap(heap) {}
+
+    void grow(size_t next) {
+        T *moved = static_cast<T *>(heap_allocate_or_throw(*heap, next * sizeof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new(&moved[i]) T(std::move(items[i]));
+            items[i].~T();
+        }
+        if (items) heap->deallocate(items);
+        items = moved;
+        capacity = next;
+    }
+
+public:
+    static HeapArray *create(HeapT &heap) {
+        return new(heap_allocate_or_throw(heap, sizeof(HeapArray))) HeapArray(&heap);
+    }
+
+    // nullptr unless p was returned by create() on heap and not destroyed. The header is only read once p is
+    // known to point into the heap, so any pointer can be passed.
+    static HeapArray *from(const HeapT &heap, void *p) {
+        if (!heap.contains(p, sizeof(HeapArray)) || reinterpret_cast<uintptr_t>(p) % alignof(HeapArray) != 0) {
+            return nullptr;
+        }
+        auto *array = static_cast<HeapArray *>(p);
+        return array->magic == MAGIC ? array : nullptr;
+    }
+
+    static void destroy(HeapArray *array) {
+        HeapT *heap = array->heap;
+        for (size_t i = 0; i < array->count; i++) array->items[i].~T();
+        if (array->items) heap->deallocate(array->items);
+        array->magic = 0;
+        array->~HeapArray();
+        heap->deallocate(array);
+    }
+
+    void push(const T &value) {
+        if (count == capacity) grow(capacity ? capacity * 2 : 8);
+        new(&items[count++]) T(value);
+    }
+
+    void reserve(size_t n) {
+        if (n > capacity) grow(n);
+    }
+
+    [[nodiscard]] size_t size() const { return count; }
+
+    // nullptr when out of bounds
+    T *at(int64_t i) {
+        return i >= 0 && static_cast<size_t>(i) < count ? &items[i] : nullptr;
+    }
+};
+
+// Open addressing hash map laid out like a Swiss table: one control byte per slot (empty, deleted or 7 bits of
+// the hash) probed a group of 16 at a time, then a flat array of key/value slots. Groups are matched with SSE2
+// where available.
+template<typename K, typename V, typename Hash, typename Eq, typename HeapT>
+class SwissMap {
+    static constexpr uint32_t MAGIC = 0x4D415053; // "MAPS"
+    static constexpr size_t GROUP = 16;
+    static constexpr uint8_t EMPTY = 0x80;
+    static constexpr uint8_t DELETED = 0xFE;
+
+    struct Slot {
+        K key;
+        V value;
+    };
+
+    // bit i set for every control byte of the group that matches
+    struct Group {
+#if defined(__SSE2__)
+        __m128i ctrl;
+
+        explicit Group(const uint8_t *p) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) {}
+
+        [[nodiscard]] uint32_t match(uint8_t tag) const {
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(tag)), ctrl));
+        }
+
+        // empty and deleted are the only control bytes with the high bit set
+        [[nodiscard]] uint32_t match_free() const { return _mm_movemask_epi8(ctrl); }
+#else
+        const uint8_t *ctrl;
+
+        explicit Group(const uint8_t *p) : ctrl(p) {}
+
+        [[nodiscard]] uint32_t match(uint8_t tag) const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP; i++) mask |= static_cast<uint32_t>(ctrl[i] == tag) << i;
+            return mask;
+        }
+
+        [[nodiscard]] uint32_t match_free() const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP; i++) mask |= static_cast<uint32_t>(ctrl[i] >> 7) << i;
+            return mask;
+        }
+#endif
+
+        [[nodiscard]] uint32_t match_empty() const { return match(EMPTY); }
+    };
+
+    uint32_t magic = MAGIC;
+    HeapT *heap;
+    uint8_t *ctrl = nullptr; // capacity + GROUP bytes, the first GROUP are mirrored at the end
+    Slot *slots = nullptr;
+    size_t capacity = 0; // power of two, at least GROUP
+    size_t count = 0;
+    size_t tombstones = 0;
+
+    explicit SwissMap(HeapT *heap) : heap(heap) {}
+
+    static uint8_t tag(uint64_t hash) { return hash & 0x7F; }
+
+    void set_ctrl(size_t i, uint8_t value) {
+        ctrl[i] = value;
+        if (i < GROUP) ctrl[capacity + i] = value;
+    }
+
+    // slot holding key, or capacity
+    size_t find_slot(const K &key, uint64_t hash) const {
+        if (capacity == 0) return capacity;
+        size_t mask = capacity - 1;
+        size_t pos = (hash >> 7) & mask;
+        for (size_t step = GROUP;; step += GROUP) {
+            Group group(ctrl + pos);
+            for (uint32_t m = group.match(tag(hash)); m; m &= m - 1) {
+                size_t i = (pos + std::countr_zero(m)) & mask;
+                if (Eq{}(slots[i].key, key)) return i;
+            }
+            if (group.match_empty()) return capacity;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    // first empty or deleted slot on the probe sequence of hash
+    size_t free_slot(uint64_t hash) const {
+        size_t mask = capacity - 1;
+        size_t pos = (hash >> 7) & mask;
+        for (size_t step = GROUP;; step += GROUP) {
+            uint32_t m = Group(ctrl + pos).match_free();
+            if (m) return (pos + std::countr_zero(m)) & mask;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    void rehash(size_t next) {
+        uint8_t *old_ctrl = ctrl;
+        Slot *old_slots = slots;
+        size_t old_capacity = capacity;
+
+        ctrl = static_cast<uint8_t *>(heap_allocate_or_throw(*heap, next + GROUP));
+        slots = static_cast<Slot *>(heap_allocate_or_throw(*heap, next * sizeof(Slot)));
+        capacity = next;
+        tombstones = 0;
+        for (size_t i = 0; i < next + GROUP; i++) ctrl[i] = EMPTY;
+
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_ctrl[i] & 0x80) continue;
+            uint64_t hash = Hash{}(old_slots[i].key);
+            size_t slot = free_slot(hash);
+            set_ctrl(slot, tag(hash));
+            new(&slots[slot]) Slot{std::move(old_slots[i].key), std::move(old_slots[i].value)};
+            old_slots[i].~Slot();
+        }
+
+        if (old_ctrl) {
+            heap->deallocate(old_ctrl);
+            heap->deallocate(old_slots);
+        }
+    }
+
+public:
+    static SwissMap *create(HeapT &heap) {
+        return new(heap_allocate_or_throw(heap, sizeof(SwissMap))) SwissMap(&heap);
+    }
+
+    // nullptr unless p was returned by create() on heap and not destroyed. The header is only read once p is
+    // known to point into the heap, so any pointer can be passed.
+    static SwissMap *from(const HeapT &heap, void *p) {
+        if (!heap.contains(p, sizeof(SwissMap)) || reinterpret_cast<uintptr_t>(p) % alignof(SwissMap) != 0) {
+            return nullptr;
+        }
+        auto *map = static_cast<SwissMap *>(p);
+        return map->magic == MAGIC ? map : nullptr;
+    }
+
+    static void destroy(SwissMap *map) {
+        HeapT *heap = map->heap;
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (!(map->ctrl[i] & 0x80)) map->slots[i].~Slot();
+        }
+        if (map->ctrl) {
+            heap->deallocate(map->ctrl);
+            heap->deallocate(map->slots);
+        }
+        map->magic = 0;
+        map->~SwissMap();
+        heap->deallocate(map);
+    }
+
+    [[nodiscard]] size_t size() const { return count; }
+
+    // nullptr when key is missing
+    V *find(const K &key) {
+        size_t i = find_slot(key, Hash{}(key));
+        return i == capacity ? nullptr : &slots[i].value;
+    }
+
+    void set(const K &key, const V &value) {
+        uint64_t hash = Hash{}(key);
+        size_t i = find_slot(key, hash);
+        if (i != capacity) {
+            slots[i].value = value;
+            return;
+        }
+
+        // at most 7/8 full, counting tombstones
+        if (capacity == 0 || (count + tombstones + 1) * 8 > capacity * 7) {
+            rehash(capacity == 0 ? GROUP : count * 2 >= capacity ? capacity * 2 : capacity);
+        }
+
+        i = free_slot(hash);
+        if (ctrl[i] == DELETED) tombstones--;
+        set_ctrl(i, tag(hash));
+        new(&slots[i]) Slot{key, value};
+        count++;
+    }
+
+    bool erase(const K &key) {
+        size_t i = find_slot(key, Hash{}(key));
+        if (i == capacity) return false;
+        slots[i].~Slot();
+        set_ctrl(i, DELETED);
+        count--;
+        tombstones++;
+        return true;
+    }
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CIR_HASH_X86 1
+#include <immintrin.h>
+#endif
+
+// Hashes behind the std.hash externs: a 64 bit wyhash style hash for hash tables and fingerprints, and CRC32C
+// (Castagnoli) for checksums, using the SSE4.2 crc32 instruction when the CPU has it.
+namespace hashing {
+    namespace detail {
+        constexpr uint64_t P0 = 0xa0761d6478bd642full;
+        constexpr uint64_t P1 = 0xe7037ed1a0b428dbull;
+        constexpr uint64_t P2 = 0x8ebc6af09c88c6e3ull;
+        constexpr uint64_t P3 = 0x589965cc75374cc3ull;
+
+        inline uint64_t read64(const uint8_t *p) {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t read32(const uint8_t *p) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        // 1 to 3 bytes
+        inline uint64_t read_small(const uint8_t *p, size_t n) {
+            return static_cast<uint64_t>(p[0]) << 16 | static_cast<uint64_t>(p[n >> 1]) << 8 | p[n - 1];
+        }
+
+        // a, b = low and high half of a * b
+        inline void multiply(uint64_t &a, uint64_t &b) {
+#ifdef __SIZEOF_INT128__
+            __uint128_t r = static_cast<__uint128_t>(a) * b;
+            a = static_cast<uint64_t>(r);
+            b = static_cast<uint64_t>(r >> 64);
+#else
+            uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32, b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+            uint64_t lo = a_lo * b_lo, mid1 = a_hi * b_lo, mid2 = a_lo * b_hi, hi = a_hi * b_hi;
+            uint64_t carry = ((lo >> 32) + (mid1 & 0xFFFFFFFF) + (mid2 & 0xFFFFFFFF)) >> 32;
+            a = lo + (mid1 << 32) + (mid2 << 32);
+            b = hi + (mid1 >> 32) + (mid2 >> 32) + carry;
+#endif
+        }
+
+        inline uint64_t mix(uint64_t a, uint64_t b) {
+            multiply(a, b);
+            return a ^ b;
+        }
+    }
+
+    // wyhash's construction: 128 bit multiply-fold mixing, 48 bytes per round in three independent lanes. Not
+    // guaranteed to match other wyhash releases bit for bit.
+    inline uint64_t wyhash(const void *data, size_t n, uint64_t seed = 0) {
+        using namespace detail;
+        const auto *p = static_cast<const uint8_t *>(data);
+        seed ^= mix(seed ^ P0, P1);
+        uint64_t a, b;
+        if (n <= 16) {
+            if (n >= 4) {
+                a = read32(p) << 32 | read32(p + ((n >> 3) << 2));
+                b = read32(p + n - 4) << 32 | read32(p + n - 4 - ((n >> 3) << 2));
+            } else if (n > 0) {
+                a = read_small(p, n);
+                b = 0;
+            } else {
+                a = b = 0;
+            }
+        } else {
+            size_t i = n;
+            if (i > 48) {
+                uint64_t see1 = seed, see2 = seed;
+                do {
+                    seed = mix(read64(p) ^ P1, read64(p + 8) ^ seed);
+                    see1 = mix(read64(p + 16) ^ P2, read64(p + 24) ^ see1);
+                    see2 = mix(read64(p + 32) ^ P3, read64(p + 40) ^ see2);
+                    p += 48;
+                    i -= 48;
+                } while (i > 48);
+                seed ^= see1 ^ see2;
+            }
+            while (i > 16) {
+                seed = mix(read64(p) ^ P1, read64(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+            a = read64(p + i - 16);
+            b = read64(p + i - 8);
+        }
+        a ^= P1;
+        b ^= seed;
+        multiply(a, b);
+        return mix(a ^ P0 ^ n, b ^ P1);
+    }
+
+    namespace generic {
+        constexpr std::array<uint32_t, 256> crc32c_table = [] {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++) crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+                table[i] = crc;
+            }
+            return table;
+        }();
+
+        inline uint32_t crc32c(uint32_t crc, const uint8_t *p, size_t n) {
+            for (size_t i = 0; i < n; i++) crc = crc32c_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+            return crc;
+        }
+    }
+
+#ifdef CIR_HASH_X86
+    namespace sse42 {
+        __attribute__((target("sse4.2"))) inline uint32_t crc32c(uint32_t crc, const uint8_t *p, size_t n) {
+            size_t i = 0;
+#ifdef __x86_64__
+            uint64_t wide = crc;
+            for (; i + 8 <= n; i += 8) wide = _mm_crc32_u64(wide, detail::read64(p + i));
+            crc = static_cast<uint32_t>(wide);
+#endif
+            for (; i < n; i++) crc = _mm_crc32_u8(crc, p[i]);
+            return crc;
+        }
+    }
+#endif
+
+    // the checksum continues from crc, so buffers can be fed in pieces
+    inline uint32_t crc32c(const void *data, size_t n, uint32_t crc = 0) {
+        using Kernel = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+        static const Kernel kernel = [] {
+#ifdef CIR_HASH_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("sse4.2")) return static_cast<Kernel>(sse42::crc32c);
+#endif
+            return static_cast<Kernel>(generic::crc32c);
+        }();
+        return ~kernel(~crc, static_cast<const uint8_t *>(data), n);
+    }
+}
@@ -8,6 +8,7 @@ class Heap {
 
     struct Block {
         size_t size;
+        size_t length; // bytes requested, size is aligned up
         bool is_free;
         Block *next;
         Block *prev;
@@ -63,6 +64,7 @@ public:
     void *allocate(size_t size) {
         if (size == 0) return nullptr;
 
+        size_t length = size;
         size = align(size);
         Block *block = findFreeBlock(size);
 
@@ -70,6 +72,7 @@ public:
 
         splitBlock(block, size);
         block->is_free = false;
+        block->length = length;
 
         return reinterpret_cast<uint8_t *>(block) + sizeof(Block);
     }
@@ -83,6 +86,18 @@ public:
         block->is_free = true;
     }
 
+    // whether size bytes at ptr lie inside the heap's memory
+    bool contains(const void *ptr, size_t size) const {
+        auto at = reinterpret_cast<uintptr_t>(ptr);
+        auto begin = reinterpret_cast<uintptr_t>(heap.data());
+        return at >= begin && size <= heap.size() && at - begin <= heap.size() - size;
+    }
+
+    // bytes requested for the allocation starting at ptr
+    static size_t allocationSize(const void *ptr) {
+        return reinterpret_cast<const Block *>(static_cast<const uint8_t *>(ptr) - sizeof(Block))->length;
+    }
+
     void coalesce() const {
         Block *current = free_list;
 
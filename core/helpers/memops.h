@@ -0,0 +1,285 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CIR_MEMOPS_X86 1
+#include <immintrin.h>
+#endif
+
+// Bulk memory kernels behind the memset/memcmp/memchr/memmove instructions and the std.str externs. On x86 the
+// widest version the CPU supports (AVX2, else SSE2) is picked the first time they are used, elsewhere they are the
+// C library functions and a portable search.
+namespace memops {
+    struct Kernels {
+        void (*fill)(uint8_t *dst, uint8_t value, size_t n);
+        int (*compare)(const uint8_t *a, const uint8_t *b, size_t n); // -1, 0 or 1
+        const uint8_t *(*find)(const uint8_t *p, uint8_t value, size_t n); // nullptr when missing
+        void (*move)(uint8_t *dst, const uint8_t *src, size_t n); // regions may overlap
+        size_t (*count)(const uint8_t *p, uint8_t value, size_t n);
+        // first occurrence of the m byte needle, nullptr when missing
+        const uint8_t *(*search)(const uint8_t *p, size_t n, const uint8_t *needle, size_t m);
+        const char *name;
+    };
+
+    inline int sign(int d) { return (d > 0) - (d < 0); }
+
+    namespace generic {
+        inline void fill(uint8_t *dst, uint8_t value, size_t n) { std::memset(dst, value, n); }
+        inline int compare(const uint8_t *a, const uint8_t *b, size_t n) { return sign(std::memcmp(a, b, n)); }
+
+        inline const uint8_t *find(const uint8_t *p, uint8_t value, size_t n) {
+            return static_cast<const uint8_t *>(std::memchr(p, value, n));
+        }
+
+        inline void move(uint8_t *dst, const uint8_t *src, size_t n) { std::memmove(dst, src, n); }
+
+        inline size_t count(const uint8_t *p, uint8_t value, size_t n) {
+            size_t found = 0;
+            for (size_t i = 0; i < n; i++) found += p[i] == value;
+            return found;
+        }
+
+        // Knuth-Morris-Pratt, linear in n + m. memchr skips ahead while nothing is matched.
+        inline const uint8_t *search(const uint8_t *p, size_t n, const uint8_t *needle, size_t m) {
+            if (m == 0) return p;
+            if (m > n) return nullptr;
+
+            // longest proper prefix of needle[0..i] that is also its suffix
+            std::vector<size_t> border(m, 0);
+            for (size_t i = 1, k = 0; i < m; i++) {
+                while (k && needle[i] != needle[k]) k = border[k - 1];
+                if (needle[i] == needle[k]) k++;
+                border[i] = k;
+            }
+
+            for (size_t i = 0, k = 0; i < n; i++) {
+                if (k == 0) {
+                    const void *next = std::memchr(p + i, needle[0], n - i);
+                    if (!next) return nullptr;
+                    i = static_cast<const uint8_t *>(next) - p;
+                }
+                while (k && p[i] != needle[k]) k = border[k - 1];
+                if (p[i] == needle[k]) k++;
+                if (k == m) return p + i + 1 - m;
+            }
+            return nullptr;
+        }
+    }
+
+#ifdef CIR_MEMOPS_X86
+    // every kernel handles whole vectors and leaves the tail to a byte loop.
+    //
+    // search compares the first and last byte of the needle against a vector of positions at once and only checks
+    // the rest where both match. Inputs with many such near misses are handed to the linear generic::search once
+    // checking them costs more than the bytes scanned, so the worst case stays linear.
+    namespace sse2 {
+        __attribute__((target("sse2"))) inline void fill(uint8_t *dst, uint8_t value, size_t n) {
+            __m128i v = _mm_set1_epi8(static_cast<char>(value));
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+            for (; i < n; i++) dst[i] = value;
+        }
+
+        __attribute__((target("sse2"))) inline int compare(const uint8_t *a, const uint8_t *b, size_t n) {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+                __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+                uint32_t diff = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFF;
+                if (diff) {
+                    size_t at = i + __builtin_ctz(diff);
+                    return a[at] < b[at] ? -1 : 1;
+                }
+            }
+            for (; i < n; i++) {
+                if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+            }
+            return 0;
+        }
+
+        __attribute__((target("sse2"))) inline const uint8_t *find(const uint8_t *p, uint8_t value, size_t n) {
+            __m128i v = _mm_set1_epi8(static_cast<char>(value));
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+                uint32_t hits = _mm_movemask_epi8(_mm_cmpeq_epi8(x, v));
+                if (hits) return p + i + __builtin_ctz(hits);
+            }
+            for (; i < n; i++) {
+                if (p[i] == value) return p + i;
+            }
+            return nullptr;
+        }
+
+        // each vector is loaded before the store that could overlap it, copying away from the overlap
+        __attribute__((target("sse2"))) inline void move(uint8_t *dst, const uint8_t *src, size_t n) {
+            if (dst <= src || dst >= src + n) {
+                size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), x);
+                }
+                for (; i < n; i++) dst[i] = src[i];
+            } else {
+                size_t i = n;
+                for (; i >= 16; i -= 16) {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i - 16));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i - 16), x);
+                }
+                for (; i > 0; i--) dst[i - 1] = src[i - 1];
+            }
+        }
+
+        __attribute__((target("sse2"))) inline size_t count(const uint8_t *p, uint8_t value, size_t n) {
+            __m128i v = _mm_set1_epi8(static_cast<char>(value));
+            size_t found = 0;
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+                found += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)));
+            }
+            for (; i < n; i++) found += p[i] == value;
+            return found;
+        }
+
+        __attribute__((target("sse2"))) inline const uint8_t *search(const uint8_t *p, size_t n, const uint8_t *needle,
+                                                                     size_t m) {
+            if (m == 0) return p;
+            if (m > n) return nullptr;
+            __m128i first = _mm_set1_epi8(static_cast<char>(needle[0]));
+            __m128i last = _mm_set1_epi8(static_cast<char>(needle[m - 1]));
+            size_t checked = 0;
+            size_t i = 0;
+            for (; i + m - 1 + 16 <= n; i += 16) {
+                __m128i x = _mm_cmpeq_epi8(first, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)));
+                __m128i y = _mm_cmpeq_epi8(last, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + m - 1)));
+                auto hits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(x, y)));
+                for (; hits; hits &= hits - 1) {
+                    const uint8_t *at = p + i + __builtin_ctz(hits);
+                    if (std::memcmp(at + 1, needle + 1, m - 1) == 0) return at;
+                    checked += m;
+                }
+                if (checked > i + 4 * 16) break;
+            }
+            return generic::search(p + i, n - i, needle, m);
+        }
+    }
+
+    namespace avx2 {
+        __attribute__((target("avx2"))) inline void fill(uint8_t *dst, uint8_t value, size_t n) {
+            __m256i v = _mm256_set1_epi8(static_cast<char>(value));
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+            for (; i < n; i++) dst[i] = value;
+        }
+
+        __attribute__((target("avx2"))) inline int compare(const uint8_t *a, const uint8_t *b, size_t n) {
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+                __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+                uint32_t diff = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+                if (diff) {
+                    size_t at = i + __builtin_ctz(diff);
+                    return a[at] < b[at] ? -1 : 1;
+                }
+            }
+            for (; i < n; i++) {
+                if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+            }
+            return 0;
+        }
+
+        __attribute__((target("avx2"))) inline const uint8_t *find(const uint8_t *p, uint8_t value, size_t n) {
+            __m256i v = _mm256_set1_epi8(static_cast<char>(value));
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+                uint32_t hits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, v));
+                if (hits) return p + i + __builtin_ctz(hits);
+            }
+            for (; i < n; i++) {
+                if (p[i] == value) return p + i;
+            }
+            return nullptr;
+        }
+
+        __attribute__((target("avx2"))) inline void move(uint8_t *dst, const uint8_t *src, size_t n) {
+            if (dst <= src || dst >= src + n) {
+                size_t i = 0;
+                for (; i + 32 <= n; i += 32) {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), x);
+                }
+                for (; i < n; i++) dst[i] = src[i];
+            } else {
+                size_t i = n;
+                for (; i >= 32; i -= 32) {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i - 32));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i - 32), x);
+                }
+                for (; i > 0; i--) dst[i - 1] = src[i - 1];
+            }
+        }
+
+        __attribute__((target("avx2,popcnt"))) inline size_t count(const uint8_t *p, uint8_t value, size_t n) {
+            __m256i v = _mm256_set1_epi8(static_cast<char>(value));
+            size_t found = 0;
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+                found += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, v)));
+            }
+            for (; i < n; i++) found += p[i] == value;
+            return found;
+        }
+
+        __attribute__((target("avx2"))) inline const uint8_t *search(const uint8_t *p, size_t n, const uint8_t *needle,
+                                                                     size_t m) {
+            if (m == 0) return p;
+            if (m > n) return nullptr;
+            __m256i first = _mm256_set1_epi8(static_cast<char>(needle[0]));
+            __m256i last = _mm256_set1_epi8(static_cast<char>(needle[m - 1]));
+            size_t checked = 0;
+            size_t i = 0;
+            for (; i + m - 1 + 32 <= n; i += 32) {
+                __m256i x = _mm256_cmpeq_epi8(first, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i)));
+                __m256i y = _mm256_cmpeq_epi8(last,
+                                              _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + m - 1)));
+                auto hits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(x, y)));
+                for (; hits; hits &= hits - 1) {
+                    const uint8_t *at = p + i + __builtin_ctz(hits);
+                    if (std::memcmp(at + 1, needle + 1, m - 1) == 0) return at;
+                    checked += m;
+                }
+                if (checked > i + 4 * 32) break;
+            }
+            return generic::search(p + i, n - i, needle, m);
+        }
+    }
+#endif
+
+    inline Kernels select_kernels() {
+#ifdef CIR_MEMOPS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            return {avx2::fill, avx2::compare, avx2::find, avx2::move, avx2::count, avx2::search, "avx2"};
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return {sse2::fill, sse2::compare, sse2::find, sse2::move, sse2::count, sse2::search, "sse2"};
+        }
+#endif
+        return {generic::fill, generic::compare, generic::find, generic::move, generic::count, generic::search,
+                "generic"};
+    }
+
+    // chosen on first use
+    inline const Kernels &kernels() {
+        static const Kernels selected = select_kernels();
+        return selected;
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simd.h"
+
+// Reductions and transforms over int64 / double buffers, four lanes at a time through simd::Vec256 with two
+// accumulators in flight. Integer math wraps around like the VM's.
+namespace numeric {
+    template<typename T>
+    struct Lanes;
+
+    template<>
+    struct Lanes<int64_t> {
+        static simd::Vec256 splat(int64_t v) { return simd::splat(v); }
+        static simd::Vec256 add(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::add_i64(a, b); }
+        static simd::Vec256 mul(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::mul_i64(a, b); }
+        static simd::Vec256 min(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::lanes_min_i64(a, b); }
+        static simd::Vec256 max(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::lanes_max_i64(a, b); }
+        static int64_t hsum(const simd::Vec256 &v) { return simd::sum_i64(v); }
+        static int64_t hmin(const simd::Vec256 &v) { return simd::min_i64(v); }
+        static int64_t hmax(const simd::Vec256 &v) { return simd::max_i64(v); }
+
+        static int64_t plus(int64_t a, int64_t b) {
+            return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+        }
+
+        static int64_t times(int64_t a, int64_t b) {
+            return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+        }
+    };
+
+    template<>
+    struct Lanes<double> {
+        static simd::Vec256 splat(double v) { return simd::splat_f64(v); }
+        static simd::Vec256 add(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::add_f64(a, b); }
+        static simd::Vec256 mul(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::mul_f64(a, b); }
+        static simd::Vec256 min(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::lanes_min_f64(a, b); }
+        static simd::Vec256 max(const simd::Vec256 &a, const simd::Vec256 &b) { return simd::lanes_max_f64(a, b); }
+        static double hsum(const simd::Vec256 &v) { return simd::sum_f64(v); }
+        static double hmin(const simd::Vec256 &v) { return simd::min_f64(v); }
+        static double hmax(const simd::Vec256 &v) { return simd::max_f64(v); }
+        static double plus(double a, double b) { return a + b; }
+        static double times(double a, double b) { return a * b; }
+    };
+
+    template<typename T>
+    T sum(const T *p, size_t n) {
+        using L = Lanes<T>;
+        simd::Vec256 acc0 = L::splat(0), acc1 = L::splat(0);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            acc0 = L::add(acc0, simd::load(p + i));
+            acc1 = L::add(acc1, simd::load(p + i + 4));
+        }
+        T s = L::hsum(L::add(acc0, acc1));
+        for (; i < n; i++) s = L::plus(s, p[i]);
+        return s;
+    }
+
+    template<typename T>
+    T dot(const T *a, const T *b, size_t n) {
+        using L = Lanes<T>;
+        simd::Vec256 acc0 = L::splat(0), acc1 = L::splat(0);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            acc0 = L::add(acc0, L::mul(simd::load(a + i), simd::load(b + i)));
+            acc1 = L::add(acc1, L::mul(simd::load(a + i + 4), simd::load(b + i + 4)));
+        }
+        T s = L::hsum(L::add(acc0, acc1));
+        for (; i < n; i++) s = L::plus(s, L::times(a[i], b[i]));
+        return s;
+    }
+
+    // n has to be at least 1
+    template<typename T>
+    T min(const T *p, size_t n) {
+        using L = Lanes<T>;
+        T m = p[0];
+        size_t i = 0;
+        if (n >= 4) {
+            simd::Vec256 acc = simd::load(p);
+            for (i = 4; i + 4 <= n; i += 4) acc = L::min(acc, simd::load(p + i));
+            m = L::hmin(acc);
+        }
+        for (; i < n; i++) m = p[i] < m ? p[i] : m;
+        return m;
+    }
+
+    template<typename T>
+    T max(const T *p, size_t n) {
+        using L = Lanes<T>;
+        T m = p[0];
+        size_t i = 0;
+        if (n >= 4) {
+            simd::Vec256 acc = simd::load(p);
+            for (i = 4; i + 4 <= n; i += 4) acc = L::max(acc, simd::load(p + i));
+            m = L::hmax(acc);
+        }
+        for (; i < n; i++) m = p[i] > m ? p[i] : m;
+        return m;
+    }
+
+    // inclusive, in place. Every element depends on the one before, so this stays scalar.
+    template<typename T>
+    void prefix_sum(T *p, size_t n) {
+        for (size_t i = 1; i < n; i++) p[i] = Lanes<T>::plus(p[i - 1], p[i]);
+    }
+
+    // p *= a
+    template<typename T>
+    void scale(T *p, size_t n, T a) {
+        using L = Lanes<T>;
+        simd::Vec256 factor = L::splat(a);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) simd::store(p + i, L::mul(simd::load(p + i), factor));
+        for (; i < n; i++) p[i] = L::times(p[i], a);
+    }
+
+    // y += a * x
+    template<typename T>
+    void axpy(T *y, size_t n, T a, const T *x) {
+        using L = Lanes<T>;
+        simd::Vec256 factor = L::splat(a);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            simd::store(y + i, L::add(simd::load(y + i), L::mul(factor, simd::load(x + i))));
+        }
+        for (; i < n; i++) y[i] = L::plus(y[i], L::times(a, x[i]));
+    }
+
+    // p = f(p), simple enough for the compiler to vectorize where it can
+    template<typename T, typename F>
+    void map(T *p, size_t n, F f) {
+        for (size_t i = 0; i < n; i++) p[i] = f(p[i]);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+// Buffered program output. Text collects in a fixed buffer and goes to the sink in one write when the buffer fills up
+// or on flush(). The sink is a stdio stream, which std::cout writes through as well, so text written with std::cout
+// after a flush() still comes out in order.
+class OutputBuffer {
+    std::unique_ptr<char[]> data;
+    size_t capacity;
+    size_t used = 0;
+    FILE *sink;
+
+    void drain() {
+        if (used) std::fwrite(data.get(), 1, used, sink);
+        used = 0;
+    }
+
+public:
+    explicit OutputBuffer(size_t capacity, FILE *sink = stdout)
+        : data(std::make_unique<char[]>(capacity)), capacity(capacity), sink(sink) {}
+
+    ~OutputBuffer() { flush(); }
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    void write(std::string_view text) {
+        if (text.size() > capacity - used) {
+            drain();
+            // too big to buffer, goes straight through
+            if (text.size() >= capacity) {
+                std::fwrite(text.data(), 1, text.size(), sink);
+                return;
+            }
+        }
+        std::memcpy(data.get() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    void put(char c) {
+        if (used == capacity) drain();
+        data[used++] = c;
+    }
+
+    [[nodiscard]] bool pending() const { return used != 0; }
+
+    void flush() {
+        drain();
+        std::fflush(sink);
+    }
+};
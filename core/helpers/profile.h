@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Runtime profile recorded by CIR::set_profile() and read back by the assembler (--profile-out / --profile-in).
+// Op indices refer to the program as the assembler parsed it, before inlining and optimization.
+struct FunctionProfile {
+    uint64_t calls = 0;
+    std::vector<uint64_t> taken{}; // per op, conditional jumps that jumped
+    std::vector<uint64_t> not_taken{};
+    std::vector<uint64_t> site_calls{}; // per op, calls made from this call site
+
+    void resize(size_t op_count) {
+        taken.assign(op_count, 0);
+        not_taken.assign(op_count, 0);
+        site_calls.assign(op_count, 0);
+    }
+
+    [[nodiscard]] size_t op_count() const { return taken.size(); }
+};
+
+class Profile {
+    static constexpr char MAGIC[4] = {'C', 'I', 'R', 'P'};
+    static constexpr uint32_t VERSION = 1;
+
+    template<typename T>
+    static void write(std::ofstream &out, T value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    static T read(std::ifstream &in) {
+        T value{};
+        if (!in.read(reinterpret_cast<char *>(&value), sizeof(value))) {
+            throw std::runtime_error("Profile truncated");
+        }
+        return value;
+    }
+
+public:
+    std::unordered_map<std::string, FunctionProfile> functions{};
+
+    [[nodiscard]] const FunctionProfile *find(const std::string &name) const {
+        auto it = functions.find(name);
+        return it == functions.end() ? nullptr : &it->second;
+    }
+
+    [[nodiscard]] uint64_t total_calls() const {
+        uint64_t total = 0;
+        for (const auto &[name, fp]: functions) total += fp.calls;
+        return total;
+    }
+
+    // at least 1% of all calls, e.g. the calls made from one call site
+    [[nodiscard]] bool is_hot(uint64_t calls) const {
+        return calls > 0 && calls * 100 >= total_calls();
+    }
+
+    void save(const std::string &path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) throw std::runtime_error("Failed to open profile file: " + path);
+
+        out.write(MAGIC, sizeof(MAGIC));
+        write<uint32_t>(out, VERSION);
+        write<uint32_t>(out, functions.size());
+
+        for (const auto &[name, fp]: functions) {
+            write<uint32_t>(out, name.size());
+            out.write(name.data(), static_cast<std::streamsize>(name.size()));
+            write<uint64_t>(out, fp.calls);
+            write<uint32_t>(out, fp.op_count());
+
+            // only ops that were counted are stored
+            uint32_t entries = 0;
+            for (size_t i = 0; i < fp.op_count(); i++) {
+                if (fp.taken[i] || fp.not_taken[i] || fp.site_calls[i]) entries++;
+            }
+            write<uint32_t>(out, entries);
+            for (size_t i = 0; i < fp.op_count(); i++) {
+                if (!fp.taken[i] && !fp.not_taken[i] && !fp.site_calls[i]) continue;
+                write<uint32_t>(out, i);
+                write<uint64_t>(out, fp.taken[i]);
+                write<uint64_t>(out, fp.not_taken[i]);
+                write<uint64_t>(out, fp.site_calls[i]);
+            }
+        }
+    }
+
+    static Profile load(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) throw std::runtime_error("Failed to open profile file: " + path);
+
+        char magic[4];
+        if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+            throw std::runtime_error("Not a CIR profile: " + path);
+        }
+        if (read<uint32_t>(in) != VERSION) throw std::runtime_error("Unsupported profile version: " + path);
+
+        Profile profile;
+        auto count = read<uint32_t>(in);
+        for (uint32_t f = 0; f < count; f++) {
+            std::string name(read<uint32_t>(in), '\0');
+            if (!in.read(name.data(), static_cast<std::streamsize>(name.size()))) {
+                throw std::runtime_error("Profile truncated");
+            }
+
+            FunctionProfile &fp = profile.functions[name];
+            fp.calls = read<uint64_t>(in);
+            fp.resize(read<uint32_t>(in));
+
+            auto entries = read<uint32_t>(in);
+            for (uint32_t e = 0; e < entries; e++) {
+                auto op = read<uint32_t>(in);
+                if (op >= fp.op_count()) throw std::runtime_error("Invalid op index in profile: " + path);
+                fp.taken[op] = read<uint64_t>(in);
+                fp.not_taken[op] = read<uint64_t>(in);
+                fp.site_calls[op] = read<uint64_t>(in);
+            }
+        }
+        return profile;
+    }
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Bump pointer arena living at the start of one heap allocation. Allocating moves a pointer, free_all releases
+// everything at once and freeing the heap allocation returns the whole arena.
+struct Region {
+    static constexpr size_t ALIGNMENT = 8;
+    static constexpr uint32_t MAGIC = 0x52474E53; // "RGNS"
+
+    uint32_t magic;
+    size_t capacity;
+    size_t used;
+
+    // whether a region of capacity bytes plus its header can be requested without wrapping around
+    static bool valid_capacity(int64_t capacity) {
+        return capacity >= 0 && static_cast<uint64_t>(capacity) <= std::numeric_limits<size_t>::max() - sizeof(Region);
+    }
+
+    // memory has to hold sizeof(Region) + capacity bytes
+    static Region *create(void *memory, size_t capacity) {
+        auto *region = static_cast<Region *>(memory);
+        region->magic = MAGIC;
+        region->capacity = capacity;
+        region->used = 0;
+        return region;
+    }
+
+    // nullptr unless p was returned by create() on memory from heap, the header is only read once p is known to
+    // point into the heap
+    template<typename HeapT>
+    static Region *from(const HeapT &heap, void *p) {
+        if (!heap.contains(p, sizeof(Region)) || reinterpret_cast<uintptr_t>(p) % alignof(Region) != 0) {
+            return nullptr;
+        }
+        auto *region = static_cast<Region *>(p);
+        return region->magic == MAGIC ? region : nullptr;
+    }
+
+    // nullptr when the region is full
+    void *allocate(size_t size) {
+        if (size == 0) return nullptr;
+
+        size_t start = (used + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (start > capacity || size > capacity - start) return nullptr;
+
+        used = start + size;
+        return reinterpret_cast<uint8_t *>(this + 1) + start;
+    }
+
+    void free_all() { used = 0; }
+};
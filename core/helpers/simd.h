@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// 256 bit vector register: four int64 or four double lanes. GCC and Clang build the packed ops from vector
+// extensions (whatever SIMD the target has), other compilers get plain per lane loops.
+#if defined(__GNUC__) || defined(__clang__)
+#define CIR_VECTOR_EXTENSIONS 1
+#endif
+
+namespace simd {
+    constexpr int LANES = 4;
+
+#ifdef CIR_VECTOR_EXTENSIONS
+    typedef int64_t i64x4 __attribute__((vector_size(32)));
+    typedef double f64x4 __attribute__((vector_size(32)));
+#endif
+
+    union alignas(32) Vec256 {
+#ifdef CIR_VECTOR_EXTENSIONS
+        i64x4 i;
+        f64x4 f;
+#endif
+        int64_t i64[LANES];
+        double f64[LANES];
+        uint8_t bytes[32];
+    };
+
+    inline Vec256 load(const void *p) {
+        Vec256 v;
+        std::memcpy(v.bytes, p, sizeof(v.bytes));
+        return v;
+    }
+
+    inline void store(void *p, const Vec256 &v) { std::memcpy(p, v.bytes, sizeof(v.bytes)); }
+
+    inline Vec256 splat(int64_t bits) {
+        Vec256 v;
+        for (int64_t &lane: v.i64) lane = bits;
+        return v;
+    }
+
+#ifdef CIR_VECTOR_EXTENSIONS
+#define CIR_VEC_BINARY(name, field, expr) \
+    inline Vec256 name(const Vec256 &a, const Vec256 &b) { Vec256 r; r.field = (expr); return r; }
+
+    CIR_VEC_BINARY(add_i64, i, a.i + b.i)
+    CIR_VEC_BINARY(sub_i64, i, a.i - b.i)
+    CIR_VEC_BINARY(mul_i64, i, a.i * b.i)
+    CIR_VEC_BINARY(add_f64, f, a.f + b.f)
+    CIR_VEC_BINARY(sub_f64, f, a.f - b.f)
+    CIR_VEC_BINARY(mul_f64, f, a.f * b.f)
+    CIR_VEC_BINARY(div_f64, f, a.f / b.f)
+    // compares give all ones in the lanes where they hold
+    CIR_VEC_BINARY(eq_i64, i, a.i == b.i)
+    CIR_VEC_BINARY(gt_i64, i, a.i > b.i)
+    CIR_VEC_BINARY(eq_f64, i, a.f == b.f)
+    CIR_VEC_BINARY(gt_f64, i, a.f > b.f)
+
+    // lanes of a where mask is set, b elsewhere
+    inline Vec256 blend(const Vec256 &mask, const Vec256 &a, const Vec256 &b) {
+        Vec256 r;
+        r.i = (mask.i & a.i) | (~mask.i & b.i);
+        return r;
+    }
+
+#undef CIR_VEC_BINARY
+#else
+    inline Vec256 lanes(const Vec256 &a, const Vec256 &b, int64_t (*fn)(int64_t, int64_t)) {
+        Vec256 r;
+        for (int l = 0; l < LANES; l++) r.i64[l] = fn(a.i64[l], b.i64[l]);
+        return r;
+    }
+
+    inline Vec256 lanes(const Vec256 &a, const Vec256 &b, double (*fn)(double, double)) {
+        Vec256 r;
+        for (int l = 0; l < LANES; l++) r.f64[l] = fn(a.f64[l], b.f64[l]);
+        return r;
+    }
+
+    inline Vec256 mask(const Vec256 &a, const Vec256 &b, bool (*fn)(const Vec256 &, const Vec256 &, int)) {
+        Vec256 r;
+        for (int l = 0; l < LANES; l++) r.i64[l] = fn(a, b, l) ? -1 : 0;
+        return r;
+    }
+
+    // unsigned wrap around like the vector extensions
+    inline Vec256 add_i64(const Vec256 &a, const Vec256 &b) {
+        return lanes(a, b, [](int64_t x, int64_t y) { return static_cast<int64_t>(static_cast<uint64_t>(x) + y); });
+    }
+
+    inline Vec256 sub_i64(const Vec256 &a, const Vec256 &b) {
+        return lanes(a, b, [](int64_t x, int64_t y) { return static_cast<int64_t>(static_cast<uint64_t>(x) - y); });
+    }
+
+    inline Vec256 mul_i64(const Vec256 &a, const Vec256 &b) {
+        return lanes(a, b, [](int64_t x, int64_t y) { return static_cast<int64_t>(static_cast<uint64_t>(x) * y); });
+    }
+
+    inline Vec256 add_f64(const Vec256 &a, const Vec256 &b) { return lanes(a, b, [](double x, double y) { return x + y; }); }
+    inline Vec256 sub_f64(const Vec256 &a, const Vec256 &b) { return lanes(a, b, [](double x, double y) { return x - y; }); }
+    inline Vec256 mul_f64(const Vec256 &a, const Vec256 &b) { return lanes(a, b, [](double x, double y) { return x * y; }); }
+    inline Vec256 div_f64(const Vec256 &a, const Vec256 &b) { return lanes(a, b, [](double x, double y) { return x / y; }); }
+
+    // compares give all ones in the lanes where they hold
+    inline Vec256 eq_i64(const Vec256 &a, const Vec256 &b) {
+        return mask(a, b, [](const Vec256 &x, const Vec256 &y, int l) { return x.i64[l] == y.i64[l]; });
+    }
+
+    inline Vec256 gt_i64(const Vec256 &a, const Vec256 &b) {
+        return mask(a, b, [](const Vec256 &x, const Vec256 &y, int l) { return x.i64[l] > y.i64[l]; });
+    }
+
+    inline Vec256 eq_f64(const Vec256 &a, const Vec256 &b) {
+        return mask(a, b, [](const Vec256 &x, const Vec256 &y, int l) { return x.f64[l] == y.f64[l]; });
+    }
+
+    inline Vec256 gt_f64(const Vec256 &a, const Vec256 &b) {
+        return mask(a, b, [](const Vec256 &x, const Vec256 &y, int l) { return x.f64[l] > y.f64[l]; });
+    }
+
+    // lanes of a where mask is set, b elsewhere
+    inline Vec256 blend(const Vec256 &mask, const Vec256 &a, const Vec256 &b) {
+        Vec256 r;
+        for (int l = 0; l < LANES; l++) r.i64[l] = (mask.i64[l] & a.i64[l]) | (~mask.i64[l] & b.i64[l]);
+        return r;
+    }
+#endif
+
+    // lane wise minimum / maximum
+    inline Vec256 lanes_min_i64(const Vec256 &a, const Vec256 &b) { return blend(gt_i64(a, b), b, a); }
+    inline Vec256 lanes_max_i64(const Vec256 &a, const Vec256 &b) { return blend(gt_i64(a, b), a, b); }
+    inline Vec256 lanes_min_f64(const Vec256 &a, const Vec256 &b) { return blend(gt_f64(a, b), b, a); }
+    inline Vec256 lanes_max_f64(const Vec256 &a, const Vec256 &b) { return blend(gt_f64(a, b), a, b); }
+
+    inline Vec256 splat_f64(double value) {
+        Vec256 v;
+        for (double &lane: v.f64) lane = value;
+        return v;
+    }
+
+    // horizontal reductions
+    inline int64_t sum_i64(const Vec256 &v) {
+        uint64_t sum = 0;
+        for (int64_t lane: v.i64) sum += static_cast<uint64_t>(lane);
+        return static_cast<int64_t>(sum);
+    }
+
+    inline int64_t min_i64(const Vec256 &v) {
+        int64_t m = v.i64[0];
+        for (int l = 1; l < LANES; l++) m = v.i64[l] < m ? v.i64[l] : m;
+        return m;
+    }
+
+    inline int64_t max_i64(const Vec256 &v) {
+        int64_t m = v.i64[0];
+        for (int l = 1; l < LANES; l++) m = v.i64[l] > m ? v.i64[l] : m;
+        return m;
+    }
+
+    inline double sum_f64(const Vec256 &v) { return (v.f64[0] + v.f64[1]) + (v.f64[2] + v.f64[3]); }
+
+    inline double min_f64(const Vec256 &v) {
+        double m = v.f64[0];
+        for (int l = 1; l < LANES; l++) m = v.f64[l] < m ? v.f64[l] : m;
+        return m;
+    }
+
+    inline double max_f64(const Vec256 &v) {
+        double m = v.f64[0];
+        for (int l = 1; l < LANES; l++) m = v.f64[l] > m ? v.f64[l] : m;
+        return m;
+    }
+}
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+// In place sorting of int64 / double buffers and key/value pairs. pdqsort with a branchless block partition, large
+// inputs whose keys only differ in a few bytes an LSD radix sort over an order preserving 64 bit key. Doubles are
+// sorted by their total order: -0.0 before 0.0, NaNs at the ends.
+namespace sorting {
+    struct KeyValue {
+        int64_t key;
+        int64_t value;
+    };
+
+    struct KeyValueF64 {
+        double key;
+        int64_t value;
+    };
+
+    // unsigned keys that sort like the values
+    inline uint64_t sort_key(int64_t v) { return static_cast<uint64_t>(v) ^ (uint64_t{1} << 63); }
+
+    inline uint64_t sort_key(double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        return bits >> 63 ? ~bits : bits | (uint64_t{1} << 63);
+    }
+
+    inline uint64_t sort_key(const KeyValue &kv) { return sort_key(kv.key); }
+    inline uint64_t sort_key(const KeyValueF64 &kv) { return sort_key(kv.key); }
+
+    struct Less {
+        template<typename T>
+        bool operator()(const T &a, const T &b) const { return sort_key(a) < sort_key(b); }
+    };
+
+    constexpr size_t INSERTION_SORT_THRESHOLD = 24;
+    constexpr size_t NINTHER_THRESHOLD = 128;
+    constexpr size_t PARTIAL_INSERTION_SORT_LIMIT = 8;
+    constexpr size_t BLOCK_SIZE = 64;
+    constexpr size_t RADIX_THRESHOLD = 1 << 16;
+    constexpr int RADIX_MAX_PASSES = 4;
+    constexpr size_t PARALLEL_THRESHOLD = 1 << 17;
+
+    namespace pdq {
+        template<typename T, typename L>
+        void insertion_sort(T *begin, T *end, L less) {
+            if (begin == end) return;
+            for (T *cur = begin + 1; cur != end; ++cur) {
+                T *sift = cur;
+                T *sift_1 = cur - 1;
+                if (less(*sift, *sift_1)) {
+                    T tmp = std::move(*sift);
+                    do { *sift-- = std::move(*sift_1); } while (sift != begin && less(tmp, *--sift_1));
+                    *sift = std::move(tmp);
+                }
+            }
+        }
+
+        // *(begin - 1) is not greater than anything in [begin, end), so the inner loop needs no bounds check
+        template<typename T, typename L>
+        void unguarded_insertion_sort(T *begin, T *end, L less) {
+            if (begin == end) return;
+            for (T *cur = begin + 1; cur != end; ++cur) {
+                T *sift = cur;
+                T *sift_1 = cur - 1;
+                if (less(*sift, *sift_1)) {
+                    T tmp = std::move(*sift);
+                    do { *sift-- = std::move(*sift_1); } while (less(tmp, *--sift_1));
+                    *sift = std::move(tmp);
+                }
+            }
+        }
+
+        // gives up (returning false) once it moved more than PARTIAL_INSERTION_SORT_LIMIT elements
+        template<typename T, typename L>
+        bool partial_insertion_sort(T *begin, T *end, L less) {
+            if (begin == end) return true;
+            size_t moved = 0;
+            for (T *cur = begin + 1; cur != end; ++cur) {
+                T *sift = cur;
+                T *sift_1 = cur - 1;
+                if (less(*sift, *sift_1)) {
+                    T tmp = std::move(*sift);
+                    do { *sift-- = std::move(*sift_1); } while (sift != begin && less(tmp, *--sift_1));
+                    *sift = std::move(tmp);
+                    moved += cur - sift;
+                }
+                if (moved > PARTIAL_INSERTION_SORT_LIMIT) return false;
+            }
+            return true;
+        }
+
+        template<typename T, typename L>
+        void sort2(T *a, T *b, L less) {
+            if (less(*b, *a)) std::iter_swap(a, b);
+        }
+
+        template<typename T, typename L>
+        void sort3(T *a, T *b, T *c, L less) {
+            sort2(a, b, less);
+            sort2(b, c, less);
+            sort2(a, b, less);
+        }
+
+        template<typename T>
+        void swap_offsets(T *first, T *last, const unsigned char *offsets_l, const unsigned char *offsets_r,
+                          size_t num, bool use_swaps) {
+            if (use_swaps) {
+                // both sides hold the same count, a cyclic permutation would not fix the last element
+                for (size_t i = 0; i < num; ++i) std::iter_swap(first + offsets_l[i], last - offsets_r[i]);
+            } else if (num > 0) {
+                T *l = first + offsets_l[0];
+                T *r = last - offsets_r[0];
+                T tmp(std::move(*l));
+                *l = std::move(*r);
+                for (size_t i = 1; i < num; ++i) {
+                    l = first + offsets_l[i];
+                    *r = std::move(*l);
+                    r = last - offsets_r[i];
+                    *l = std::move(*r);
+                }
+                *r = std::move(tmp);
+            }
+        }
+
+        // partitions around *begin, elements equal to the pivot go right. Comparisons only produce offsets, the
+        // swaps happen afterwards, so there is no branch on the comparison results.
+        template<typename T, typename L>
+        std::pair<T *, bool> partition_right_branchless(T *begin, T *end, L less) {
+            T pivot(std::move(*begin));
+            T *first = begin;
+            T *last = end;
+
+            // the median of three guarantees an element >= pivot on the left and < pivot (or the pivot) on the right
+            while (less(*++first, pivot)) {}
+            if (first - 1 == begin) {
+                while (first < last && !less(*--last, pivot)) {}
+            } else {
+                while (!less(*--last, pivot)) {}
+            }
+
+            bool already_partitioned = first >= last;
+            if (!already_partitioned) {
+                std::iter_swap(first, last);
+                ++first;
+
+                unsigned char offsets_l[BLOCK_SIZE];
+                unsigned char offsets_r[BLOCK_SIZE];
+                T *offsets_l_base = first;
+                T *offsets_r_base = last;
+                size_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+
+                while (first < last) {
+                    size_t num_unknown = last - first;
+                    size_t left_split = num_l == 0 ? (num_r == 0 ? num_unknown / 2 : num_unknown) : 0;
+                    size_t right_split = num_r == 0 ? (num_unknown - left_split) : 0;
+
+                    size_t left_count = std::min(left_split, BLOCK_SIZE);
+                    for (size_t i = 0; i < left_count; i++) {
+                        offsets_l[num_l] = static_cast<unsigned char>(i);
+                        num_l += !less(*first, pivot);
+                        ++first;
+                    }
+
+                    size_t right_count = std::min(right_split, BLOCK_SIZE);
+                    for (size_t i = 0; i < right_count; i++) {
+                        offsets_r[num_r] = static_cast<unsigned char>(i + 1);
+                        num_r += less(*--last, pivot);
+                    }
+
+                    size_t num = std::min(num_l, num_r);
+                    swap_offsets(offsets_l_base, offsets_r_base, offsets_l + start_l, offsets_r + start_r, num,
+                                 num_l == num_r);
+                    num_l -= num;
+                    num_r -= num;
+                    start_l += num;
+                    start_r += num;
+
+                    if (num_l == 0) {
+                        start_l = 0;
+                        offsets_l_base = first;
+                    }
+                    if (num_r == 0) {
+                        start_r = 0;
+                        offsets_r_base = last;
+                    }
+                }
+
+                // leftovers of one side, the other is done
+                if (num_l) {
+                    while (num_l--) std::iter_swap(offsets_l_base + offsets_l[start_l + num_l], --last);
+                    first = last;
+                }
+                if (num_r) {
+                    while (num_r--) std::iter_swap(offsets_r_base - offsets_r[start_r + num_r], first), ++first;
+                    last = first;
+                }
+            }
+
+            T *pivot_pos = first - 1;
+            *begin = std::move(*pivot_pos);
+            *pivot_pos = std::move(pivot);
+            return {pivot_pos, already_partitioned};
+        }
+
+        // puts everything equal to the pivot left of it, used when the pivot equals the element before the range
+        template<typename T, typename L>
+        T *partition_left(T *begin, T *end, L less) {
+            T pivot(std::move(*begin));
+            T *first = begin;
+            T *last = end;
+
+            while (less(pivot, *--last)) {}
+            if (last + 1 == end) {
+                while (first < last && !less(pivot, *++first)) {}
+            } else {
+                while (!less(pivot, *++first)) {}
+            }
+
+            while (first < last) {
+                std::iter_swap(first, last);
+                while (less(pivot, *--last)) {}
+                while (!less(pivot, *++first)) {}
+            }
+
+            T *pivot_pos = last;
+            *begin = std::move(*pivot_pos);
+            *pivot_pos = std::move(pivot);
+            return pivot_pos;
+        }
+
+        template<typename T, typename L>
+        void loop(T *begin, T *end, L less, int bad_allowed, bool leftmost) {
+            while (true) {
+                size_t size = end - begin;
+                if (size < INSERTION_SORT_THRESHOLD) {
+                    if (leftmost) insertion_sort(begin, end, less);
+                    else unguarded_insertion_sort(begin, end, less);
+                    return;
+                }
+
+                // pivot into *begin: median of three, or pseudo median of nine for large ranges
+                size_t s2 = size / 2;
+                if (size > NINTHER_THRESHOLD) {
+                    sort3(begin, begin + s2, end - 1, less);
+                    sort3(begin + 1, begin + (s2 - 1), end - 2, less);
+                    sort3(begin + 2, begin + (s2 + 1), end - 3, less);
+                    sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1), less);
+                    std::iter_swap(begin, begin + s2);
+                } else {
+                    sort3(begin + s2, begin, end - 1, less);
+                }
+
+                // the pivot equals the element before this range: many duplicates, take them out in one go
+                if (!leftmost && !less(*(begin - 1), *begin)) {
+                    begin = partition_left(begin, end, less) + 1;
+                    continue;
+                }
+
+                auto [pivot_pos, already_partitioned] = partition_right_branchless(begin, end, less);
+                size_t l_size = pivot_pos - begin;
+                size_t r_size = end - (pivot_pos + 1);
+
+                if (l_size < size / 8 || r_size < size / 8) {
+                    // too many bad partitions, fall back to a guaranteed n log n
+                    if (--bad_allowed == 0) {
+                        std::make_heap(begin, end, less);
+                        std::sort_heap(begin, end, less);
+                        return;
+                    }
+
+                    // break up patterns that produce bad pivots
+                    if (l_size >= INSERTION_SORT_THRESHOLD) {
+                        std::iter_swap(begin, begin + l_size / 4);
+                        std::iter_swap(pivot_pos - 1, pivot_pos - l_size / 4);
+                        if (l_size > NINTHER_THRESHOLD) {
+                            std::iter_swap(begin + 1, begin + (l_size / 4 + 1));
+                            std::iter_swap(begin + 2, begin + (l_size / 4 + 2));
+                            std::iter_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+                            std::iter_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+                        }
+                    }
+                    if (r_size >= INSERTION_SORT_THRESHOLD) {
+                        std::iter_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+                        std::iter_swap(end - 1, end - r_size / 4);
+                        if (r_size > NINTHER_THRESHOLD) {
+                            std::iter_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+                            std::iter_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+                            std::iter_swap(end - 2, end - (1 + r_size / 4));
+                            std::iter_swap(end - 3, end - (2 + r_size / 4));
+                        }
+                    }
+                } else if (already_partitioned && partial_insertion_sort(begin, pivot_pos, less) &&
+                           partial_insertion_sort(pivot_pos + 1, end, less)) {
+                    // no swaps were needed and both halves are (nearly) sorted
+                    return;
+                }
+
+                // recurse into the left part, loop on the right one
+                loop(begin, pivot_pos, less, bad_allowed, leftmost);
+                begin = pivot_pos + 1;
+                leftmost = false;
+            }
+        }
+    }
+
+    template<typename T, typename L = Less>
+    void pdqsort(T *begin, T *end, L less = {}) {
+        size_t size = end - begin;
+        if (size < 2) return;
+        int log2 = 0;
+        while (size >>= 1) log2++;
+        pdq::loop(begin, end, less, log2, true);
+    }
+
+    // byte histograms of every key, one per digit
+    template<typename T>
+    std::vector<size_t> digit_counts(const T *data, size_t n) {
+        std::vector<size_t> counts(8 * 256);
+        for (size_t i = 0; i < n; i++) {
+            uint64_t key = sort_key(data[i]);
+            for (int d = 0; d < 8; d++) counts[d * 256 + ((key >> (8 * d)) & 0xFF)]++;
+        }
+        return counts;
+    }
+
+    // digits that differ between keys, the passes a radix sort can not skip
+    template<typename T>
+    int active_digits(const T *data, size_t n, const std::vector<size_t> &counts) {
+        int active = 0;
+        for (int d = 0; d < 8; d++) active += counts[d * 256 + ((sort_key(data[0]) >> (8 * d)) & 0xFF)] != n;
+        return active;
+    }
+
+    // stable, 8 bits per pass, passes where every key has the same digit are skipped
+    template<typename T>
+    void radix_sort(T *data, size_t n, const std::vector<size_t> &counts) {
+        if (n < 2) return;
+        std::vector<T> buffer(n);
+        T *from = data;
+        T *to = buffer.data();
+        for (int d = 0; d < 8; d++) {
+            const size_t *count = &counts[d * 256];
+            if (count[(sort_key(from[0]) >> (8 * d)) & 0xFF] == n) continue;
+
+            size_t offsets[256];
+            size_t total = 0;
+            for (int b = 0; b < 256; b++) {
+                offsets[b] = total;
+                total += count[b];
+            }
+            for (size_t i = 0; i < n; i++) to[offsets[(sort_key(from[i]) >> (8 * d)) & 0xFF]++] = from[i];
+            std::swap(from, to);
+        }
+        if (from != data) std::copy(from, from + n, data);
+    }
+
+    template<typename T>
+    void radix_sort(T *data, size_t n) {
+        if (n >= 2) radix_sort(data, n, digit_counts(data, n));
+    }
+
+    // every radix pass scatters the whole buffer, so keys spread over all 8 bytes are faster with pdqsort
+    template<typename T>
+    void sort(T *data, size_t n) {
+        if (n >= RADIX_THRESHOLD) {
+            std::vector<size_t> counts = digit_counts(data, n);
+            if (active_digits(data, n, counts) <= RADIX_MAX_PASSES) {
+                radix_sort(data, n, counts);
+                return;
+            }
+        }
+        pdqsort(data, data + n);
+    }
+
+    // equal keys keep their order, for key/value pairs
+    template<typename T>
+    void stable_sort(T *data, size_t n) {
+        if (n <= INSERTION_SORT_THRESHOLD) pdq::insertion_sort(data, data + n, Less{});
+        else radix_sort(data, n);
+    }
+
+    // sorts one chunk per worker, then merges neighbouring chunks in parallel rounds
+    template<typename T>
+    void parallel_sort(T *data, size_t n, ThreadPool &pool) {
+        size_t chunks = 1;
+        while (chunks * 2 <= pool.size() && n / (chunks * 2) >= PARALLEL_THRESHOLD / 2) chunks *= 2;
+        if (chunks < 2) {
+            sort(data, n);
+            return;
+        }
+
+        auto bound = [&](size_t chunk) { return data + n * chunk / chunks; };
+        pool.parallel_for(chunks, [&](size_t c) { sort(bound(c), bound(c + 1) - bound(c)); });
+
+        std::vector<T> buffer(n);
+        T *from = data;
+        T *to = buffer.data();
+        for (size_t width = 1; width < chunks; width *= 2) {
+            pool.parallel_for(chunks / (width * 2), [&](size_t pair) {
+                size_t lo = pair * width * 2;
+                T *begin = from + (bound(lo) - data);
+                T *mid = from + (bound(lo + width) - data);
+                T *end = from + (bound(lo + width * 2) - data);
+                std::merge(begin, mid, mid, end, to + (bound(lo) - data), Less{});
+            });
+            std::swap(from, to);
+        }
+        if (from != data) std::copy(from, from + n, data);
+    }
+
+    // first index whose element is not less than value
+    template<typename T>
+    size_t lower_bound(const T *data, size_t n, T value) {
+        if (n == 0) return 0;
+        uint64_t key = sort_key(value);
+        // branchless binary search: the range halves every step, only its start depends on the comparison
+        size_t base = 0;
+        while (n > 1) {
+            size_t half = n / 2;
+            base = sort_key(data[base + half]) < key ? base + half : base;
+            n -= half;
+        }
+        return base + (sort_key(data[base]) < key);
+    }
+}
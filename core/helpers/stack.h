@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// Operand stack with a fixed capacity, allocated once. Bounds are checked with a single compare per push/pop
+// (or per pushn/popn), pop moves the value out instead of copying it.
+template<typename T>
+class BoundedStack {
+    std::unique_ptr<T[]> slots;
+    size_t capacity_;
+    size_t top = 0;
+
+public:
+    explicit BoundedStack(size_t capacity) : slots(std::make_unique<T[]>(capacity)), capacity_(capacity) {}
+
+    // throws unless n more values fit
+    void reserve(size_t n) const {
+        if (n > capacity_ - top) throw std::runtime_error("Stack overflow");
+    }
+
+    // throws unless at least n values are on the stack
+    void require(size_t n) const {
+        if (n > top) throw std::runtime_error("Stack underflow");
+    }
+
+    void push(const T &value) {
+        reserve(1);
+        slots[top++] = value;
+    }
+
+    void push(T &&value) {
+        reserve(1);
+        slots[top++] = std::move(value);
+    }
+
+    // callers checked the bounds with reserve() / require()
+    void push_unchecked(const T &value) { slots[top++] = value; }
+    T pop_unchecked() { return std::move(slots[--top]); }
+
+    T pop() {
+        require(1);
+        return pop_unchecked();
+    }
+
+    T &emplace() {
+        reserve(1);
+        slots[top] = T{};
+        return slots[top++];
+    }
+
+    [[nodiscard]] size_t size() const { return top; }
+    [[nodiscard]] size_t capacity() const { return capacity_; }
+    [[nodiscard]] bool empty() const { return top == 0; }
+
+    T &operator[](size_t i) { return slots[i]; }
+    const T &operator[](size_t i) const { return slots[i]; }
+
+    T *begin() { return slots.get(); }
+    T *end() { return slots.get() + top; }
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Text of the VM's owned strings (see Word): immutable, length prefixed and reference counted, so copying a string
+// word only bumps a count. The text stays NUL terminated and can still be read as a C string. Slices share the text
+// of the buffer they were cut from instead of copying it.
+namespace strings {
+    struct Buffer {
+        uint32_t refs;
+        uint32_t length;
+
+        char *text() { return reinterpret_cast<char *>(this + 1); }
+
+        static Buffer *of(const char *text) { return reinterpret_cast<Buffer *>(const_cast<char *>(text)) - 1; }
+    };
+
+    // text of a new buffer with one reference, the caller fills in length bytes
+    inline char *allocate(size_t length) {
+        if (length > UINT32_MAX) throw std::runtime_error("String of " + std::to_string(length) + " bytes is too long");
+        auto *buffer = static_cast<Buffer *>(::operator new(sizeof(Buffer) + length + 1));
+        buffer->refs = 1;
+        buffer->length = static_cast<uint32_t>(length);
+        buffer->text()[length] = '\0';
+        return buffer->text();
+    }
+
+    inline const char *create(std::string_view s) {
+        char *text = allocate(s.size());
+        std::memcpy(text, s.data(), s.size());
+        return text;
+    }
+
+    inline void retain(const char *text) { Buffer::of(text)->refs++; }
+
+    inline void release(const char *text) {
+        Buffer *buffer = Buffer::of(text);
+        if (--buffer->refs == 0) ::operator delete(buffer);
+    }
+
+    inline size_t length(const char *text) { return Buffer::of(text)->length; }
+
+    struct SliceGroup;
+
+    struct Slice {
+        uint32_t refs;
+        uint32_t length;
+        const char *chars;
+        const char *root; // text of the buffer chars points into, one reference held
+        SliceGroup *group; // allocation this slice lives in, nullptr for one of its own
+    };
+
+    // slices cut from one string in one go (std.str.split) share a single allocation, freed with the last of them
+    struct SliceGroup {
+        size_t refs; // one per slice handed out, plus one for whoever is cutting
+        size_t used;
+        size_t capacity;
+
+        Slice *slices() { return reinterpret_cast<Slice *>(this + 1); }
+    };
+
+    inline SliceGroup *group(size_t capacity) {
+        auto *group = static_cast<SliceGroup *>(::operator new(sizeof(SliceGroup) + capacity * sizeof(Slice)));
+        *group = {1, 0, capacity};
+        return group;
+    }
+
+    inline void release(SliceGroup *group) {
+        if (--group->refs == 0) ::operator delete(group);
+    }
+
+    // takes the next slot of group when one is given and not full
+    inline Slice *slice(const char *root, const char *chars, size_t length, SliceGroup *group = nullptr) {
+        Slice *slice;
+        if (group && group->used < group->capacity) {
+            slice = &group->slices()[group->used++];
+            group->refs++;
+        } else {
+            group = nullptr;
+            slice = new Slice;
+        }
+        *slice = {1, static_cast<uint32_t>(length), chars, root, group};
+        retain(root);
+        return slice;
+    }
+
+    inline void release(Slice *slice) {
+        if (--slice->refs == 0) {
+            release(slice->root);
+            if (slice->group) release(slice->group);
+            else delete slice;
+        }
+    }
+}
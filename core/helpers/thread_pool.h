@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel externs. parallel_for blocks until every task is done and rethrows
+// the first exception one of them threw.
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [&] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; i++) workers.emplace_back([this] { work(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker: workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    [[nodiscard]] size_t size() const { return workers.size(); }
+
+    // runs fn(0) .. fn(count - 1) on the workers
+    void parallel_for(size_t count, const std::function<void(size_t)> &fn) {
+        std::mutex done_mutex;
+        std::condition_variable done;
+        size_t remaining = count;
+        std::exception_ptr error;
+
+        {
+            std::lock_guard lock(mutex);
+            for (size_t i = 0; i < count; i++) {
+                tasks.emplace([&, i] {
+                    std::exception_ptr thrown;
+                    try {
+                        fn(i);
+                    } catch (...) {
+                        thrown = std::current_exception();
+                    }
+                    std::lock_guard done_lock(done_mutex);
+                    if (thrown && !error) error = thrown;
+                    if (--remaining == 0) done.notify_one();
+                });
+            }
+        }
+        wake.notify_all();
+
+        std::unique_lock lock(done_mutex);
+        done.wait(lock, [&] { return remaining == 0; });
+        if (error) std::rethrow_exception(error);
+    }
+
+    // shared by the standard library, one worker per hardware thread
+    static ThreadPool &shared() {
+        static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+        return pool;
+    }
+};
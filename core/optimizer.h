@@ -0,0 +1,1949 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <bitset>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cir.h"
+
+// Control flow / SSA analyses over Function::ops and the optimization passes built on them.
+// SSA values are never materialized as new registers, so lowering back is just dropping/inserting ops and
+// relocating jumps. The only renaming is register-file compaction of registers private to one function.
+namespace cir_opt {
+    constexpr size_t NONE = SIZE_MAX;
+
+    // analyses track every register plus the compare flag as one extra slot
+    constexpr int FLAG_SLOT = Config::REGISTER_COUNT;
+    constexpr int SLOT_COUNT = Config::REGISTER_COUNT + 1;
+    using RegSet = std::bitset<SLOT_COUNT>;
+
+    struct OpEffects {
+        std::array<int, 3> reads{};
+        size_t read_count = 0;
+        int write = -1;
+        std::array<bool, 3> reg_args{}; // which op.args name registers
+        bool barrier = false; // may read and write any register (calls, returns)
+        bool pure = false; // result only depends on the operands, no side effects, cannot throw
+    };
+
+    inline bool is_jump(OpType type) {
+        return type == OpType::Jmp || type == OpType::Je || type == OpType::Jne;
+    }
+
+    // jump targets are stored as target - 1 because the VM advances co after the jump
+    inline int64_t jump_target(const Op &op) {
+        return op.args[0].as_int() + 1;
+    }
+
+    inline void set_jump_target(Op &op, int64_t target) {
+        op.args[0] = Word::from_int(target - 1);
+    }
+
+    inline bool ends_flow(OpType type) {
+        type = generic_op(type);
+        return type == OpType::Jmp || type == OpType::Ret || type == OpType::Halt || type == OpType::TailCall;
+    }
+
+    // quickened ops (IAddQ, CallQ, ...) only exist while a program runs and are treated like their generic form
+    inline OpEffects op_effects(const Op &op) {
+        OpEffects e;
+        auto reg = [&](size_t i) {
+            e.reg_args[i] = true;
+            return static_cast<int>(op.args[i].as_int());
+        };
+        auto read = [&](int r) { e.reads[e.read_count++] = r; };
+
+        switch (generic_op(op.type)) {
+            case OpType::Mov:
+                if (op.args[0].has_flag(WordFlag::Register)) read(reg(0));
+                e.write = reg(1);
+                e.pure = true;
+                break;
+
+            case OpType::PushReg: read(reg(0));
+                break;
+
+            case OpType::Pop: e.write = reg(0);
+                break;
+
+            case OpType::IAdd:
+            case OpType::ISub:
+            case OpType::IMul:
+            case OpType::IAddInt:
+            case OpType::ISubInt:
+            case OpType::IMulInt:
+            case OpType::IAnd:
+            case OpType::IOr:
+            case OpType::IXor:
+            case OpType::Shl:
+            case OpType::Shr:
+            case OpType::FAdd:
+            case OpType::FSub:
+            case OpType::FMul:
+            case OpType::FDiv:
+                read(reg(0));
+                read(reg(1));
+                e.write = 0;
+                e.pure = true;
+                break;
+
+            // pointer arithmetic is bounds checked with fat pointers, so it may throw
+            case OpType::IDiv:
+            case OpType::IMod:
+            case OpType::PAdd:
+            case OpType::PSub:
+            case OpType::PDiff:
+                read(reg(0));
+                read(reg(1));
+                e.write = 0;
+                break;
+
+            case OpType::Not:
+            case OpType::Neg:
+            case OpType::I2F:
+            case OpType::F2I:
+            case OpType::P2I:
+            case OpType::I2P:
+                read(reg(0));
+                e.write = 0;
+                e.pure = true;
+                break;
+
+            case OpType::Inc:
+            case OpType::Dec:
+            case OpType::IncInt:
+            case OpType::DecInt:
+                read(reg(0));
+                e.write = reg(0);
+                e.pure = true;
+                break;
+
+            case OpType::ICmp:
+            case OpType::Gt:
+            case OpType::Lt:
+            case OpType::Gte:
+            case OpType::Lte:
+            case OpType::FCmp:
+                read(reg(0));
+                read(reg(1));
+                e.write = FLAG_SLOT;
+                e.pure = true;
+                break;
+
+            case OpType::Je:
+            case OpType::Jne: read(FLAG_SLOT);
+                break;
+
+            case OpType::Cast:
+                // int -> int and float -> float leave r0 untouched
+                read(reg(1));
+                read(0);
+                e.write = 0;
+                break;
+
+            case OpType::LocalGet:
+            case OpType::Alloc:
+            case OpType::RegionNew: e.write = 0;
+                break;
+
+            case OpType::RegionAlloc: read(reg(0));
+                if (op.args[1].has_flag(WordFlag::Register)) read(reg(1));
+                e.write = 0;
+                break;
+
+            case OpType::RegionFreeAll: read(reg(0));
+                break;
+
+            // collections may grow, throw on bad handles or indices and are shared through their handle
+            case OpType::ArrNew:
+            case OpType::MapNew: e.write = 0;
+                break;
+
+            case OpType::ArrLen:
+            case OpType::MapLen: read(reg(0));
+                e.write = 0;
+                break;
+
+            case OpType::ArrFree:
+            case OpType::MapFree: read(reg(0));
+                break;
+
+            case OpType::ArrPush: read(reg(0));
+                read(reg(1));
+                break;
+
+            case OpType::ArrGet:
+            case OpType::MapGet: read(reg(0));
+                read(reg(1));
+                e.write = 0;
+                break;
+
+            case OpType::MapFind:
+            case OpType::MapDel: read(reg(0));
+                read(reg(1));
+                e.write = FLAG_SLOT;
+                break;
+
+            case OpType::ArrSet:
+            case OpType::MapSet: read(reg(0));
+                read(reg(1));
+                read(reg(2));
+                break;
+
+            case OpType::SAlloc:
+                if (op.args[0].has_flag(WordFlag::Register)) read(reg(0));
+                e.write = reg(1);
+                break;
+
+            case OpType::LocalSet: read(reg(1));
+                break;
+
+            case OpType::Load:
+            case OpType::Store:
+                read(reg(0));
+                read(reg(1));
+                break;
+
+            case OpType::Free: read(reg(0));
+                break;
+
+            case OpType::FnRef:
+            case OpType::MovInt:
+                e.write = reg(1);
+                e.pure = true;
+                break;
+
+            case OpType::CallReg: reg(0);
+                e.barrier = true;
+                break;
+
+            // the index register is packed into args[2], so it is read but not a reg_arg
+            case OpType::LdI8:
+            case OpType::LdI16:
+            case OpType::LdI32:
+            case OpType::LdI64:
+            case OpType::LdU8:
+            case OpType::LdU16:
+            case OpType::LdU32:
+            case OpType::LdF32:
+            case OpType::LdF64:
+            case OpType::StI8:
+            case OpType::StI16:
+            case OpType::StI32:
+            case OpType::StI64:
+            case OpType::StF32:
+            case OpType::StF64: {
+                if (is_store(op.type)) read(reg(0));
+                else e.write = reg(0);
+                read(reg(1));
+                MemOperand mem = MemOperand::unpack(op.args[2].as_int());
+                if (mem.index >= 0) read(mem.index);
+            }
+            break;
+
+            // vector registers are not tracked, only the scalar registers these touch are
+            case OpType::VLoad:
+            case OpType::VStore: {
+                read(reg(1));
+                MemOperand mem = MemOperand::unpack(op.args[2].as_int());
+                if (mem.index >= 0) read(mem.index);
+            }
+            break;
+
+            case OpType::VSplat: read(reg(0));
+                break;
+
+            case OpType::MemSet:
+            case OpType::MemCmp:
+            case OpType::MemChr:
+            case OpType::MemMove:
+                read(reg(0));
+                if (op.type == OpType::MemCmp || op.type == OpType::MemMove ||
+                    op.args[1].has_flag(WordFlag::Register)) {
+                    read(reg(1));
+                }
+                if (op.args[2].has_flag(WordFlag::Register)) read(reg(2));
+                if (op.type == OpType::MemCmp || op.type == OpType::MemChr) e.write = 0;
+                break;
+
+            // throw on anything but strings
+            case OpType::StrLen: read(reg(0));
+                e.write = 0;
+                break;
+
+            case OpType::StrConcat: read(reg(0));
+                read(reg(1));
+                e.write = 0;
+                break;
+
+            case OpType::StrSlice: read(reg(0));
+                if (op.args[1].has_flag(WordFlag::Register)) read(reg(1));
+                if (op.args[2].has_flag(WordFlag::Register)) read(reg(2));
+                e.write = 0;
+                break;
+
+            case OpType::StrEq: read(reg(0));
+                read(reg(1));
+                e.write = FLAG_SLOT;
+                break;
+
+            case OpType::VSumI64:
+            case OpType::VMinI64:
+            case OpType::VMaxI64:
+            case OpType::VSumF64:
+            case OpType::VMinF64:
+            case OpType::VMaxF64: e.write = 0;
+                break;
+
+            // a register range does not fit reads/write, see register_range()
+            case OpType::PushN:
+            case OpType::PopN: reg(0);
+                reg(1);
+                e.barrier = true;
+                break;
+
+            case OpType::Call:
+            case OpType::CallExtern:
+            case OpType::TailCall:
+            case OpType::Ret:
+            case OpType::Halt: e.barrier = true;
+                break;
+
+            default: break;
+        }
+
+        // garbage register operands are left alone
+        for (size_t i = 0; i < e.read_count; i++) {
+            if (e.reads[i] < 0 || e.reads[i] >= SLOT_COUNT) e.barrier = true;
+        }
+        if (e.write >= SLOT_COUNT || (e.write < 0 && e.write != -1)) e.barrier = true;
+        if (e.barrier) {
+            e.read_count = 0;
+            e.write = -1;
+            e.pure = false;
+        }
+
+        return e;
+    }
+
+    struct BasicBlock {
+        size_t begin = 0;
+        size_t end = 0; // one past the last op
+        std::vector<size_t> succs{};
+        std::vector<size_t> preds{};
+        bool exits = false; // control can leave the function at the end of this block
+    };
+
+    struct Loop {
+        size_t header = 0;
+        std::vector<bool> body{}; // indexed by block
+        std::vector<size_t> blocks{};
+    };
+
+    class ControlFlowGraph {
+    public:
+        std::vector<BasicBlock> blocks{};
+        std::vector<size_t> block_of{}; // op index -> block
+        std::vector<size_t> rpo{}; // reachable blocks in reverse post order
+        std::vector<size_t> rpo_index{};
+        std::vector<size_t> idom{};
+        std::vector<std::vector<size_t> > dom_children{};
+
+        explicit ControlFlowGraph(const Function &fn) {
+            const auto &ops = fn.ops;
+            size_t n = ops.size();
+            if (n == 0) return;
+
+            std::vector<bool> leader(n + 1, false);
+            leader[0] = true;
+            for (size_t i = 0; i < n; i++) {
+                if (is_jump(ops[i].type)) {
+                    int64_t t = jump_target(ops[i]);
+                    if (t >= 0 && static_cast<size_t>(t) < n) leader[t] = true;
+                }
+                if (is_jump(ops[i].type) || ends_flow(ops[i].type)) leader[i + 1] = true;
+            }
+
+            block_of.assign(n, 0);
+            for (size_t i = 0; i < n; i++) {
+                if (leader[i]) {
+                    if (!blocks.empty()) blocks.back().end = i;
+                    blocks.push_back({i, n});
+                }
+                block_of[i] = blocks.size() - 1;
+            }
+
+            for (size_t b = 0; b < blocks.size(); b++) {
+                BasicBlock &bb = blocks[b];
+                const Op &last = ops[bb.end - 1];
+
+                auto edge_to = [&](int64_t t) {
+                    if (t >= 0 && static_cast<size_t>(t) < n) bb.succs.push_back(block_of[t]);
+                    else bb.exits = true;
+                };
+
+                if (is_jump(last.type)) edge_to(jump_target(last));
+                if (last.type == OpType::Ret || last.type == OpType::Halt || last.type == OpType::TailCall) {
+                    bb.exits = true;
+                } else if (last.type != OpType::Jmp) {
+                    edge_to(static_cast<int64_t>(bb.end));
+                }
+
+                std::sort(bb.succs.begin(), bb.succs.end());
+                bb.succs.erase(std::unique(bb.succs.begin(), bb.succs.end()), bb.succs.end());
+                for (size_t s: bb.succs) blocks[s].preds.push_back(b);
+            }
+
+            compute_rpo();
+            compute_dominators();
+        }
+
+        [[nodiscard]] bool reachable(size_t b) const { return rpo_index[b] != NONE; }
+
+        [[nodiscard]] bool dominates(size_t a, size_t b) const {
+            if (!reachable(a) || !reachable(b)) return false;
+            while (b != a && b != 0) b = idom[b];
+            return b == a;
+        }
+
+        [[nodiscard]] std::vector<std::vector<size_t> > dominance_frontiers() const {
+            std::vector<std::vector<size_t> > df(blocks.size());
+            for (size_t b: rpo) {
+                if (blocks[b].preds.size() < 2) continue;
+                for (size_t p: blocks[b].preds) {
+                    if (!reachable(p)) continue;
+                    for (size_t runner = p; runner != idom[b]; runner = idom[runner]) {
+                        if (std::find(df[runner].begin(), df[runner].end(), b) == df[runner].end()) {
+                            df[runner].push_back(b);
+                        }
+                        if (runner == 0) break;
+                    }
+                }
+            }
+            return df;
+        }
+
+        // natural loops, back edges sharing a header are merged into one loop
+        [[nodiscard]] std::vector<Loop> loops() const {
+            std::map<size_t, Loop> by_header;
+
+            for (size_t b: rpo) {
+                for (size_t h: blocks[b].succs) {
+                    if (!dominates(h, b)) continue;
+
+                    Loop &loop = by_header[h];
+                    if (loop.body.empty()) {
+                        loop.header = h;
+                        loop.body.assign(blocks.size(), false);
+                        loop.body[h] = true;
+                    }
+
+                    std::vector<size_t> work{b};
+                    while (!work.empty()) {
+                        size_t x = work.back();
+                        work.pop_back();
+                        if (loop.body[x]) continue;
+                        loop.body[x] = true;
+                        for (size_t p: blocks[x].preds) {
+                            if (reachable(p)) work.push_back(p);
+                        }
+                    }
+                }
+            }
+
+            std::vector<Loop> result;
+            for (auto &[h, loop]: by_header) {
+                for (size_t b = 0; b < blocks.size(); b++) {
+                    if (loop.body[b]) loop.blocks.push_back(b);
+                }
+                result.push_back(std::move(loop));
+            }
+            return result;
+        }
+
+    private:
+        void compute_rpo() {
+            rpo_index.assign(blocks.size(), NONE);
+            std::vector<bool> visited(blocks.size(), false);
+            std::vector<size_t> post;
+            std::vector<std::pair<size_t, size_t> > stack{{0, 0}};
+            visited[0] = true;
+
+            while (!stack.empty()) {
+                auto &[b, next] = stack.back();
+                if (next < blocks[b].succs.size()) {
+                    size_t s = blocks[b].succs[next++];
+                    if (!visited[s]) {
+                        visited[s] = true;
+                        stack.emplace_back(s, 0);
+                    }
+                } else {
+                    post.push_back(b);
+                    stack.pop_back();
+                }
+            }
+
+            rpo.assign(post.rbegin(), post.rend());
+            for (size_t i = 0; i < rpo.size(); i++) rpo_index[rpo[i]] = i;
+        }
+
+        // Cooper, Harvey, Kennedy - "A Simple, Fast Dominance Algorithm"
+        void compute_dominators() {
+            idom.assign(blocks.size(), NONE);
+            idom[0] = 0;
+
+            auto intersect = [&](size_t a, size_t b) {
+                while (a != b) {
+                    while (rpo_index[a] > rpo_index[b]) a = idom[a];
+                    while (rpo_index[b] > rpo_index[a]) b = idom[b];
+                }
+                return a;
+            };
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (size_t i = 1; i < rpo.size(); i++) {
+                    size_t b = rpo[i];
+                    size_t new_idom = NONE;
+                    for (size_t p: blocks[b].preds) {
+                        if (idom[p] == NONE) continue;
+                        new_idom = new_idom == NONE ? p : intersect(p, new_idom);
+                    }
+                    if (new_idom != idom[b]) {
+                        idom[b] = new_idom;
+                        changed = true;
+                    }
+                }
+            }
+
+            dom_children.assign(blocks.size(), {});
+            for (size_t b: rpo) {
+                if (b != 0) dom_children[idom[b]].push_back(b);
+            }
+        }
+    };
+
+    // what a function does to the register file and the stack, callees included
+    struct RegisterSummary {
+        RegSet reads{}; // read before written
+        RegSet writes{}; // may be written
+        bool stack_neutral = true; // never pops below its entry depth and returns with the stack as it found it
+        bool opaque = false; // reaches callr or an extern with unknown effects
+    };
+
+    using SummaryMap = std::unordered_map<std::string, RegisterSummary>;
+
+    // externs whose register and stack effects are known, anything else may touch every register
+    struct ExternEffects {
+        RegSet reads{};
+        RegSet writes{};
+    };
+
+    inline const std::unordered_map<std::string, ExternEffects> &known_externs() {
+        static const std::unordered_map<std::string, ExternEffects> table = {
+            {"std.print", {RegSet(1), {}}},
+        };
+        return table;
+    }
+
+    // registers pushn reads or popn writes, empty for any other op
+    inline RegSet register_range(const Op &op) {
+        RegSet range;
+        if (op.type != OpType::PushN && op.type != OpType::PopN) return range;
+        for (int64_t r = std::max<int64_t>(op.args[0].as_int(), 0);
+             r <= op.args[1].as_int() && r < Config::REGISTER_COUNT; r++) {
+            range.set(r);
+        }
+        return range;
+    }
+
+    inline const char *call_target(const Op &op) {
+        OpType type = generic_op(op.type);
+        if ((type == OpType::Call || type == OpType::TailCall || type == OpType::CallExtern) &&
+            op.args[0].has_flag(WordFlag::String)) {
+            return static_cast<const char *>(op.args[0].as_ptr());
+        }
+        return nullptr;
+    }
+
+    // registers an op names explicitly or implicitly (r0 destinations), without the compare flag
+    inline RegSet referenced_registers(const Function &fn) {
+        RegSet refs;
+        for (const auto &op: fn.ops) {
+            OpEffects e = op_effects(op);
+            for (size_t i = 0; i < e.read_count; i++) refs.set(e.reads[i]);
+            if (e.write >= 0) refs.set(e.write);
+            refs |= register_range(op);
+            for (size_t i = 0; i < Config::OpArgCount; i++) {
+                int64_t r = op.args[i].as_int();
+                if (e.reg_args[i] && r >= 0 && r < Config::REGISTER_COUNT) refs.set(r);
+            }
+        }
+        refs.reset(FLAG_SLOT);
+        return refs;
+    }
+
+    // registers the externs fn calls may read without naming them, all of them for an extern we know nothing about
+    inline RegSet extern_registers(const Function &fn) {
+        RegSet regs;
+        for (const auto &op: fn.ops) {
+            if (generic_op(op.type) != OpType::CallExtern) continue;
+            auto it = known_externs().find(call_target(op) ? call_target(op) : "");
+            if (it == known_externs().end()) return RegSet().set();
+            regs |= it->second.reads;
+        }
+        return regs;
+    }
+
+    struct RegisterPressure {
+        std::string function;
+        size_t registers = 0; // distinct registers referenced
+        size_t max_live = 0; // most of them live at the same time
+        size_t spills_removed = 0; // pushr/pop pairs around calls that were dropped
+        size_t spills_fused = 0; // runs of pushr/pop turned into one pushn/popn
+        bool compacted = false;
+    };
+
+    // Backward register liveness. Without summaries every call reads everything and everything is live
+    // when control leaves the function; with summaries calls only read what the callee reads.
+    class Liveness {
+    public:
+        std::vector<RegSet> live_in{};
+        std::vector<RegSet> live_out{};
+
+        Liveness(const Function &fn, const ControlFlowGraph &cfg, const SummaryMap *summaries = nullptr,
+                 RegSet exit_live = RegSet().set()) : fn(fn), cfg(cfg), summaries(summaries), exit_live(exit_live) {
+            size_t count = cfg.blocks.size();
+            live_in.assign(count, {});
+            live_out.assign(count, {});
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (size_t i = cfg.rpo.size(); i-- > 0;) {
+                    size_t b = cfg.rpo[i];
+                    RegSet out;
+                    if (cfg.blocks[b].exits) out = exit_live;
+                    for (size_t s: cfg.blocks[b].succs) out |= live_in[s];
+
+                    RegSet in = out;
+                    for (size_t o = cfg.blocks[b].end; o-- > cfg.blocks[b].begin;) transfer(fn.ops[o], in);
+
+                    if (in != live_in[b] || out != live_out[b]) {
+                        live_in[b] = in;
+                        live_out[b] = out;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // live before op, given what is live after it
+        void transfer(const Op &op, RegSet &live) const {
+            OpEffects e = op_effects(op);
+            if (e.barrier) {
+                barrier_transfer(op, live);
+                return;
+            }
+            if (e.write >= 0 && op.type != OpType::Cast) live.reset(e.write);
+            for (size_t i = 0; i < e.read_count; i++) live.set(e.reads[i]);
+        }
+
+        // registers live right after the op at index op
+        [[nodiscard]] RegSet live_after(size_t op) const {
+            size_t b = cfg.block_of[op];
+            RegSet live = live_out[b];
+            for (size_t o = cfg.blocks[b].end; o-- > op + 1;) transfer(fn.ops[o], live);
+            return live;
+        }
+
+    private:
+        const Function &fn;
+        const ControlFlowGraph &cfg;
+        const SummaryMap *summaries;
+        RegSet exit_live;
+
+        void barrier_transfer(const Op &op, RegSet &live) const {
+            if (op.type == OpType::PushN) {
+                live |= register_range(op);
+                return;
+            }
+            if (op.type == OpType::PopN) {
+                live &= ~register_range(op);
+                return;
+            }
+            if (summaries == nullptr) {
+                live.set();
+                return;
+            }
+
+            switch (op.type) {
+                case OpType::Ret:
+                case OpType::Halt: live = exit_live;
+                    return;
+
+                case OpType::Call:
+                case OpType::TailCall: {
+                    auto it = summaries->find(call_target(op) ? call_target(op) : "");
+                    if (it == summaries->end() || it->second.opaque) break;
+                    if (op.type == OpType::TailCall) live = exit_live;
+                    live |= it->second.reads;
+                }
+                    return;
+
+                case OpType::CallExtern: {
+                    auto it = known_externs().find(call_target(op) ? call_target(op) : "");
+                    if (it == known_externs().end()) break;
+                    live |= it->second.reads;
+                }
+                    return;
+
+                default: break;
+            }
+            live.set();
+        }
+    };
+
+    // Static register types, forward over the CFG. Unknown means no path reaches the point yet.
+    enum class RegType : uint8_t { Unknown, Integer, Float, Pointer, Boolean, Null, Any };
+    using TypeState = std::array<RegType, Config::REGISTER_COUNT>;
+
+    inline RegType join(RegType a, RegType b) {
+        if (a == RegType::Unknown) return b;
+        if (b == RegType::Unknown) return a;
+        return a == b ? a : RegType::Any;
+    }
+
+    inline RegType type_of(const Word &w) {
+        switch (w.type) {
+            case WordType::Integer: return RegType::Integer;
+            case WordType::Float: return RegType::Float;
+            case WordType::Pointer: return RegType::Pointer;
+            case WordType::Boolean: return RegType::Boolean;
+            case WordType::Null: return RegType::Null;
+        }
+        return RegType::Any;
+    }
+
+    // type of r0 after `cast target, rX` with rX of type source, mirrors CIR::execute_op
+    inline RegType cast_result(const std::string &target, RegType source, RegType r0) {
+        if (source == RegType::Integer) {
+            if (target == "int") return r0;
+            if (target == "float") return RegType::Float;
+            if (target == "ptr") return RegType::Pointer;
+        } else if (source == RegType::Float) {
+            if (target == "int") return RegType::Integer;
+            if (target == "float") return r0;
+        } else if (source == RegType::Pointer && target == "int") {
+            return RegType::Integer;
+        }
+        return RegType::Any;
+    }
+
+    class TypeInference {
+    public:
+        std::vector<TypeState> type_in{};
+
+        TypeInference(const Function &fn, const ControlFlowGraph &cfg, const SummaryMap *summaries = nullptr)
+            : summaries(summaries) {
+            TypeState unknown;
+            unknown.fill(RegType::Unknown);
+            type_in.assign(cfg.blocks.size(), unknown);
+            if (cfg.blocks.empty()) return;
+
+            // registers hold whatever the caller left in them
+            type_in[0].fill(RegType::Any);
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (size_t b: cfg.rpo) {
+                    TypeState state = type_in[b];
+                    for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) transfer(fn.ops[i], state);
+
+                    for (size_t succ: cfg.blocks[b].succs) {
+                        for (int r = 0; r < Config::REGISTER_COUNT; r++) {
+                            RegType joined = join(type_in[succ][r], state[r]);
+                            if (joined != type_in[succ][r]) {
+                                type_in[succ][r] = joined;
+                                changed = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // types after op, given the types before it
+        void transfer(const Op &op, TypeState &types) const {
+            OpEffects e = op_effects(op);
+            if (e.barrier) {
+                RegSet clobbered = RegSet().set();
+                const char *target = call_target(op);
+                if (op.type == OpType::PushN || op.type == OpType::PopN) {
+                    clobbered = register_range(op);
+                    if (op.type == OpType::PushN) clobbered.reset();
+                } else if (op.type == OpType::CallExtern) {
+                    auto it = known_externs().find(target ? target : "");
+                    if (it != known_externs().end()) clobbered = it->second.writes;
+                } else if (op.type == OpType::Call && summaries && target) {
+                    auto it = summaries->find(target);
+                    if (it != summaries->end()) clobbered = it->second.writes;
+                }
+                for (int r = 0; r < Config::REGISTER_COUNT; r++) {
+                    if (clobbered[r]) types[r] = RegType::Any;
+                }
+                return;
+            }
+            if (e.write < 0 || e.write == FLAG_SLOT) return;
+
+            switch (op.type) {
+                case OpType::Mov:
+                    types[e.write] = op.args[0].has_flag(WordFlag::Register) ? types[e.reads[0]] : type_of(op.args[0]);
+                    break;
+
+                case OpType::Cast: {
+                    const char *target = op.args[0].type == WordType::Pointer
+                                             ? static_cast<const char *>(op.args[0].as_ptr())
+                                             : nullptr;
+                    types[0] = target ? cast_result(target, types[e.reads[0]], types[0]) : RegType::Any;
+                }
+                break;
+
+                case OpType::FAdd:
+                case OpType::FSub:
+                case OpType::FMul:
+                case OpType::FDiv:
+                case OpType::I2F:
+                case OpType::LdF32:
+                case OpType::LdF64:
+                case OpType::VSumF64:
+                case OpType::VMinF64:
+                case OpType::VMaxF64: types[e.write] = RegType::Float;
+                    break;
+
+                case OpType::Alloc:
+                case OpType::RegionNew:
+                case OpType::RegionAlloc:
+                case OpType::SAlloc:
+                case OpType::ArrNew:
+                case OpType::MapNew:
+                case OpType::MemChr:
+                case OpType::StrConcat:
+                case OpType::StrSlice:
+                case OpType::I2P:
+                case OpType::PAdd:
+                case OpType::PSub: types[e.write] = RegType::Pointer;
+                    break;
+
+                case OpType::Pop:
+                case OpType::LocalGet:
+                case OpType::ArrGet:
+                case OpType::MapGet: types[e.write] = RegType::Any;
+                    break;
+
+                // everything else that writes a register produces an integer
+                default: types[e.write] = RegType::Integer;
+                    break;
+            }
+        }
+
+    private:
+        const SummaryMap *summaries;
+    };
+
+    struct TypeSite {
+        std::string function;
+        size_t op = 0;
+        std::string reason;
+    };
+
+    // SSA over the register file. Registers are not renamed in the code, the form only names the values
+    // each op reads and writes so passes can reason about them.
+    class SSAForm {
+    public:
+        enum class ValueKind : uint8_t { Entry, Def, Phi };
+
+        struct Value {
+            ValueKind kind;
+            size_t block;
+            size_t op; // defining op, NONE for entry values and phis
+            int slot;
+            std::vector<size_t> args{}; // phi operands, ordered like the block's preds
+        };
+
+        std::vector<Value> values{};
+        std::vector<std::vector<size_t> > phis{}; // per block
+        std::vector<std::array<size_t, 3> > op_reads{}; // values read by each op
+        std::vector<size_t> op_prior{}; // value held by the written slot before the op
+        std::vector<size_t> op_def{}; // value written by the op
+        RegSet tracked{};
+
+        SSAForm(const Function &fn, const ControlFlowGraph &cfg) {
+            size_t n = fn.ops.size();
+            op_reads.assign(n, {NONE, NONE, NONE});
+            op_prior.assign(n, NONE);
+            op_def.assign(n, NONE);
+            phis.assign(cfg.blocks.size(), {});
+            if (n == 0) return;
+
+            std::vector<OpEffects> effects(n);
+            std::vector<std::vector<size_t> > def_blocks(SLOT_COUNT);
+            std::vector<bool> has_barrier(cfg.blocks.size(), false);
+
+            tracked.set(FLAG_SLOT);
+            for (size_t i = 0; i < n; i++) {
+                effects[i] = op_effects(fn.ops[i]);
+                for (size_t r = 0; r < effects[i].read_count; r++) tracked.set(effects[i].reads[r]);
+                if (effects[i].write >= 0) tracked.set(effects[i].write);
+            }
+
+            for (size_t i = 0; i < n; i++) {
+                size_t b = cfg.block_of[i];
+                if (effects[i].barrier) has_barrier[b] = true;
+                if (effects[i].write >= 0) def_blocks[effects[i].write].push_back(b);
+            }
+
+            // minimal SSA: phis at the iterated dominance frontier of every definition
+            auto df = cfg.dominance_frontiers();
+            for (int s = 0; s < SLOT_COUNT; s++) {
+                if (!tracked[s]) continue;
+
+                std::vector<size_t> work = def_blocks[s];
+                work.push_back(0);
+                for (size_t b = 0; b < cfg.blocks.size(); b++) {
+                    if (has_barrier[b]) work.push_back(b);
+                }
+
+                std::vector<bool> has_phi(cfg.blocks.size(), false);
+                std::vector<bool> queued(cfg.blocks.size(), false);
+                for (size_t b: work) queued[b] = true;
+
+                while (!work.empty()) {
+                    size_t b = work.back();
+                    work.pop_back();
+                    for (size_t y: df[b]) {
+                        if (has_phi[y]) continue;
+                        has_phi[y] = true;
+                        phis[y].push_back(new_value(ValueKind::Phi, y, NONE, s));
+                        values.back().args.assign(cfg.blocks[y].preds.size(), NONE);
+                        if (!queued[y]) {
+                            queued[y] = true;
+                            work.push_back(y);
+                        }
+                    }
+                }
+            }
+
+            rename(cfg, effects);
+        }
+
+    private:
+        size_t new_value(ValueKind kind, size_t block, size_t op, int slot) {
+            values.push_back({kind, block, op, slot});
+            return values.size() - 1;
+        }
+
+        void rename(const ControlFlowGraph &cfg, const std::vector<OpEffects> &effects) {
+            std::vector<std::vector<size_t> > current(SLOT_COUNT);
+            for (int s = 0; s < SLOT_COUNT; s++) {
+                if (tracked[s]) current[s].push_back(new_value(ValueKind::Entry, 0, NONE, s));
+            }
+
+            // explicit dominator tree walk, second visit of a block pops what the first one pushed
+            std::vector<std::pair<size_t, bool> > stack{{0, false}};
+            std::vector<std::vector<int> > pushed(cfg.blocks.size());
+
+            while (!stack.empty()) {
+                auto [b, leaving] = stack.back();
+                stack.pop_back();
+
+                if (leaving) {
+                    for (int s: pushed[b]) current[s].pop_back();
+                    continue;
+                }
+
+                auto define = [&](int s, size_t value) {
+                    current[s].push_back(value);
+                    pushed[b].push_back(s);
+                };
+
+                for (size_t phi: phis[b]) define(values[phi].slot, phi);
+
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    const OpEffects &e = effects[i];
+                    for (size_t r = 0; r < e.read_count; r++) op_reads[i][r] = current[e.reads[r]].back();
+
+                    if (e.barrier) {
+                        for (int s = 0; s < SLOT_COUNT; s++) {
+                            if (tracked[s]) define(s, new_value(ValueKind::Def, b, i, s));
+                        }
+                    } else if (e.write >= 0) {
+                        op_prior[i] = current[e.write].back();
+                        op_def[i] = new_value(ValueKind::Def, b, i, e.write);
+                        define(e.write, op_def[i]);
+                    }
+                }
+
+                for (size_t s: cfg.blocks[b].succs) {
+                    const auto &preds = cfg.blocks[s].preds;
+                    size_t pred_index = std::find(preds.begin(), preds.end(), b) - preds.begin();
+                    for (size_t phi: phis[s]) values[phi].args[pred_index] = current[values[phi].slot].back();
+                }
+
+                stack.emplace_back(b, true);
+                for (size_t child: cfg.dom_children[b]) stack.emplace_back(child, false);
+            }
+        }
+    };
+
+    // Value numbering over the SSA form: values computed by the same pure op from the same operand values
+    // get the same number, copies keep the number of their source.
+    class ValueNumbering {
+    public:
+        std::vector<size_t> vn{}; // per SSA value
+        std::unordered_map<size_t, int64_t> int_constants{}; // vn -> integer held by it
+
+        ValueNumbering(const Function &fn, const ControlFlowGraph &cfg, const SSAForm &ssa) {
+            vn.assign(ssa.values.size(), NONE);
+            std::map<std::array<uint64_t, 4>, size_t> expressions;
+
+            // entry values and everything clobbered by calls is unknown
+            for (size_t v = 0; v < ssa.values.size(); v++) {
+                const auto &value = ssa.values[v];
+                if (value.kind == SSAForm::ValueKind::Entry ||
+                    (value.kind == SSAForm::ValueKind::Def && ssa.op_def[value.op] != v)) {
+                    vn[v] = fresh();
+                }
+            }
+
+            for (size_t b: cfg.rpo) {
+                for (size_t phi: ssa.phis[b]) {
+                    // operands from back edges are not numbered yet, such phis stay unique
+                    size_t common = NONE;
+                    bool same = true;
+                    for (size_t arg: ssa.values[phi].args) {
+                        size_t arg_vn = arg == NONE ? NONE : vn[arg];
+                        if (arg_vn == NONE || (common != NONE && arg_vn != common)) {
+                            same = false;
+                            break;
+                        }
+                        common = arg_vn;
+                    }
+                    vn[phi] = same && common != NONE ? common : fresh();
+                }
+
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    size_t def = ssa.op_def[i];
+                    if (def == NONE) continue;
+                    vn[def] = number_op(fn.ops[i], ssa.op_reads[i], expressions);
+                }
+            }
+        }
+
+        [[nodiscard]] bool is_int_constant(size_t value_number, int64_t &out) const {
+            auto it = int_constants.find(value_number);
+            if (it == int_constants.end()) return false;
+            out = it->second;
+            return true;
+        }
+
+    private:
+        size_t next = 0;
+
+        size_t fresh() { return next++; }
+
+        size_t lookup(std::map<std::array<uint64_t, 4>, size_t> &expressions, const std::array<uint64_t, 4> &key) {
+            auto it = expressions.find(key);
+            if (it != expressions.end()) return it->second;
+            size_t v = fresh();
+            expressions[key] = v;
+            return v;
+        }
+
+        size_t number_op(const Op &op, const std::array<size_t, 3> &reads,
+                         std::map<std::array<uint64_t, 4>, size_t> &expressions) {
+            OpEffects e = op_effects(op);
+            if (!e.pure) return fresh();
+
+            auto operand = [&](size_t i) -> uint64_t { return reads[i] == NONE ? NONE : vn[reads[i]]; };
+
+            switch (op.type) {
+                case OpType::Mov: {
+                    if (op.args[0].has_flag(WordFlag::Register)) return operand(0);
+                    if (op.args[0].has_flag(WordFlag::String)) return fresh();
+
+                    uint64_t bits;
+                    std::memcpy(&bits, &op.args[0].data, sizeof(bits));
+                    size_t v = lookup(expressions, {
+                                          static_cast<uint64_t>(OpType::Mov),
+                                          static_cast<uint64_t>(op.args[0].type), op.args[0].flags, bits
+                                      });
+                    if (op.args[0].type == WordType::Integer && op.args[0].flags == 0) {
+                        int_constants[v] = op.args[0].as_int();
+                    }
+                    return v;
+                }
+
+                case OpType::FnRef: return fresh();
+
+                case OpType::Inc:
+                case OpType::Dec:
+                case OpType::Not:
+                case OpType::Neg:
+                    return lookup(expressions, {static_cast<uint64_t>(op.type), operand(0), 0, 0});
+
+                default: {
+                    uint64_t a = operand(0);
+                    uint64_t b = operand(1);
+                    bool commutative = op.type == OpType::IAdd || op.type == OpType::IMul ||
+                                       op.type == OpType::IAnd || op.type == OpType::IOr ||
+                                       op.type == OpType::IXor || op.type == OpType::ICmp;
+                    if (commutative && a > b) std::swap(a, b);
+                    return lookup(expressions, {static_cast<uint64_t>(op.type), a, b, 0});
+                }
+            }
+        }
+    };
+
+    // drops and inserts ops, then relocates jumps
+    struct Rewrite {
+        std::vector<bool> removed{};
+        std::map<size_t, std::vector<Op> > insert_before{};
+        std::unordered_set<size_t> bypass{}; // jumps that skip ops inserted before their target
+
+        explicit Rewrite(const Function &fn) : removed(fn.ops.size(), false) {
+        }
+
+        void apply(Function &fn) const {
+            size_t n = fn.ops.size();
+            std::vector<Op> new_ops;
+            std::vector<size_t> entry_pos(n + 1);
+            std::vector<size_t> op_pos(n + 1);
+            std::vector<std::pair<size_t, size_t> > jumps; // new index, old index
+
+            for (size_t i = 0; i <= n; i++) {
+                entry_pos[i] = new_ops.size();
+                auto it = insert_before.find(i);
+                if (it != insert_before.end()) new_ops.insert(new_ops.end(), it->second.begin(), it->second.end());
+                op_pos[i] = new_ops.size();
+
+                if (i < n && !removed[i]) {
+                    if (is_jump(fn.ops[i].type)) jumps.emplace_back(new_ops.size(), i);
+                    new_ops.push_back(fn.ops[i]);
+                }
+            }
+
+            for (auto [pos, old]: jumps) {
+                int64_t t = jump_target(new_ops[pos]);
+                if (t < 0 || static_cast<size_t>(t) > n) {
+                    set_jump_target(new_ops[pos], static_cast<int64_t>(new_ops.size()));
+                    continue;
+                }
+                size_t target = bypass.contains(old) ? op_pos[t] : entry_pos[t];
+                set_jump_target(new_ops[pos], static_cast<int64_t>(target));
+            }
+
+            fn.ops = std::move(new_ops);
+        }
+    };
+
+    // Profile-guided block layout: greedily places the hottest unplaced successor after each block so hot paths fall
+    // through, then fixes up branches (inverting je/jne or adding jmps) to keep the original control flow. origin, when
+    // given, receives the old index of every op, NONE for branches the layout wrote.
+    inline bool layout_hot_blocks(Function &fn, const FunctionProfile &profile, std::vector<size_t> *origin = nullptr) {
+        if (profile.op_count() != fn.ops.size()) return false;
+
+        ControlFlowGraph cfg(fn);
+        size_t n = cfg.blocks.size();
+        if (n < 2) return false;
+
+        const size_t end_block = n; // falling off / jumping to the end of the function
+        auto block_at = [&](int64_t t) -> size_t {
+            return static_cast<size_t>(t) == fn.ops.size() ? end_block : cfg.block_of[t];
+        };
+        for (const auto &op: fn.ops) {
+            if (!is_jump(op.type)) continue;
+            int64_t t = jump_target(op);
+            if (t < 0 || static_cast<size_t>(t) > fn.ops.size()) return false;
+        }
+
+        auto fallthrough = [&](size_t b) { return block_at(static_cast<int64_t>(cfg.blocks[b].end)); };
+        auto edge_weight = [&](size_t b, size_t succ) -> uint64_t {
+            size_t last = cfg.blocks[b].end - 1;
+            const Op &op = fn.ops[last];
+            if (op.type != OpType::Je && op.type != OpType::Jne) return UINT64_MAX;
+
+            bool to_target = block_at(jump_target(op)) == succ;
+            bool to_fall = fallthrough(b) == succ;
+            return (to_target ? profile.taken[last] : 0) + (to_fall ? profile.not_taken[last] : 0);
+        };
+
+        std::vector<bool> placed(n, false);
+        std::vector<size_t> order;
+        size_t cur = 0;
+        while (true) {
+            placed[cur] = true;
+            order.push_back(cur);
+            if (order.size() == n) break;
+
+            size_t best = NONE;
+            uint64_t best_weight = 0;
+            for (size_t succ: cfg.blocks[cur].succs) {
+                if (placed[succ]) continue;
+                uint64_t w = edge_weight(cur, succ);
+                // ties keep the original fall through
+                if (best == NONE || w > best_weight || (w == best_weight && succ == fallthrough(cur))) {
+                    best = succ;
+                    best_weight = w;
+                }
+            }
+            if (best == NONE) best = std::find(placed.begin(), placed.end(), false) - placed.begin();
+            cur = best;
+        }
+
+        bool identity = true;
+        for (size_t k = 0; k < n; k++) identity &= order[k] == k;
+        if (identity) return false;
+
+        std::vector<Op> out;
+        std::vector<size_t> from;
+        std::vector<size_t> new_start(n + 1);
+        std::vector<std::pair<size_t, size_t> > fixups; // jump position, target block
+
+        auto emit_jump = [&](OpType type, size_t target) {
+            fixups.emplace_back(out.size(), target);
+            out.push_back(Op{type, {Word::from_int(0), Word::from_null(), Word::from_null()}});
+            from.push_back(NONE);
+        };
+        auto keep = [&](size_t i) {
+            out.push_back(fn.ops[i]);
+            from.push_back(i);
+        };
+
+        for (size_t k = 0; k < n; k++) {
+            size_t b = order[k];
+            size_t next = k + 1 < n ? order[k + 1] : end_block;
+            const BasicBlock &bb = cfg.blocks[b];
+            new_start[b] = out.size();
+
+            for (size_t i = bb.begin; i + 1 < bb.end; i++) keep(i);
+            const Op &last = fn.ops[bb.end - 1];
+
+            switch (last.type) {
+                case OpType::Jmp:
+                    if (block_at(jump_target(last)) != next) emit_jump(OpType::Jmp, block_at(jump_target(last)));
+                    break;
+
+                case OpType::Je:
+                case OpType::Jne: {
+                    size_t target = block_at(jump_target(last));
+                    size_t fall = fallthrough(b);
+                    if (fall == next) {
+                        emit_jump(last.type, target);
+                    } else if (target == next) {
+                        emit_jump(last.type == OpType::Je ? OpType::Jne : OpType::Je, fall);
+                    } else {
+                        emit_jump(last.type, target);
+                        emit_jump(OpType::Jmp, fall);
+                    }
+                }
+                break;
+
+                case OpType::Ret:
+                case OpType::Halt:
+                case OpType::TailCall: keep(bb.end - 1);
+                    break;
+
+                default:
+                    keep(bb.end - 1);
+                    if (fallthrough(b) != next) emit_jump(OpType::Jmp, fallthrough(b));
+                    break;
+            }
+        }
+        new_start[end_block] = out.size();
+
+        for (auto [pos, target]: fixups) set_jump_target(out[pos], static_cast<int64_t>(new_start[target]));
+        fn.ops = std::move(out);
+        if (origin) *origin = std::move(from);
+        return true;
+    }
+
+    class Optimizer {
+    public:
+        std::vector<RegisterPressure> register_report{};
+        std::vector<TypeSite> type_report{}; // ops left generic because operand types are not proven
+
+        explicit Optimizer(Program &program) : program(program) {}
+
+        void run() {
+            for (auto &[name, fn]: program.functions) {
+                eliminate_redundancies(fn);
+                // every round moves ops out of a loop, so this is bounded by the nesting depth
+                while (hoist_loop_invariants(fn)) {
+                }
+                if (reduce_strength(fn)) eliminate_redundancies(fn);
+            }
+
+            optimize_register_file();
+
+            compute_summaries();
+            std::vector<std::string> names;
+            for (const auto &[name, fn]: program.functions) names.push_back(name);
+            std::sort(names.begin(), names.end());
+            type_report.clear();
+            for (const auto &name: names) specialize_types(name, program.functions[name]);
+        }
+
+        // rewrites casts and integer ops whose operand types are proven into the typed opcodes
+        void specialize_types(const std::string &name, Function &fn) {
+            ControlFlowGraph cfg(fn);
+            if (cfg.blocks.empty()) return;
+            TypeInference types(fn, cfg, &summaries);
+            Rewrite rewrite(fn);
+
+            auto unproven = [&](size_t i, const std::string &reason) {
+                type_report.push_back({name, i, reason});
+            };
+
+            for (size_t b: cfg.rpo) {
+                TypeState state = types.type_in[b];
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    Op &op = fn.ops[i];
+                    OpEffects e = op_effects(op);
+                    TypeState before = state;
+                    types.transfer(op, state);
+                    if (e.barrier) continue;
+
+                    switch (op.type) {
+                        case OpType::Cast: {
+                            if (op.args[0].type != WordType::Pointer || !op.args[0].as_ptr()) break;
+                            std::string target = static_cast<const char *>(op.args[0].as_ptr());
+                            RegType source = before[e.reads[0]];
+                            Word reg = op.args[1];
+
+                            OpType typed = OpType::Cast;
+                            if (source == RegType::Integer && target == "float") typed = OpType::I2F;
+                            else if (source == RegType::Integer && target == "ptr") typed = OpType::I2P;
+                            else if (source == RegType::Float && target == "int") typed = OpType::F2I;
+                            else if (source == RegType::Pointer && target == "int") typed = OpType::P2I;
+                            else if ((source == RegType::Integer && target == "int") ||
+                                     (source == RegType::Float && target == "float")) {
+                                rewrite.removed[i] = true;
+                                break;
+                            }
+
+                            if (typed == OpType::Cast) {
+                                unproven(i, source == RegType::Any
+                                                ? "cast source type not proven"
+                                                : "cast to " + target + " is invalid for this source");
+                                break;
+                            }
+                            op = Op{typed, {reg, Word::from_null(), Word::from_null()}};
+                        }
+                        break;
+
+                        case OpType::IAdd:
+                        case OpType::ISub:
+                        case OpType::IMul:
+                            if (before[0] != RegType::Integer) {
+                                unproven(i, "r0 not proven to hold an integer");
+                                break;
+                            }
+                            op.type = op.type == OpType::IAdd
+                                          ? OpType::IAddInt
+                                          : op.type == OpType::ISub
+                                                ? OpType::ISubInt
+                                                : OpType::IMulInt;
+                            break;
+
+                        case OpType::Inc:
+                        case OpType::Dec:
+                            if (before[e.write] != RegType::Integer) {
+                                unproven(i, "r" + std::to_string(e.write) + " not proven to hold an integer");
+                                break;
+                            }
+                            op.type = op.type == OpType::Inc ? OpType::IncInt : OpType::DecInt;
+                            break;
+
+                        case OpType::Mov:
+                            if (!op.args[0].has_flag(WordFlag::Register) && op.args[0].type == WordType::Integer &&
+                                before[e.write] == RegType::Integer) {
+                                op.type = OpType::MovInt;
+                            }
+                            break;
+
+                        default: break;
+                    }
+                }
+            }
+
+            if (std::find(rewrite.removed.begin(), rewrite.removed.end(), true) != rewrite.removed.end()) {
+                rewrite.apply(fn);
+            }
+        }
+
+        // Interprocedural register work: drops spills around calls that cannot clobber the spilled register,
+        // renumbers registers only one function uses densely, and reports register pressure per function.
+        void optimize_register_file() {
+            std::vector<std::string> names;
+            for (const auto &[name, fn]: program.functions) names.push_back(name);
+            std::sort(names.begin(), names.end());
+
+            compute_summaries();
+            std::unordered_map<std::string, size_t> spills;
+            for (const auto &name: names) spills[name] = eliminate_spills(program.functions[name]);
+            compute_summaries();
+
+            std::unordered_map<std::string, RegSet> refs;
+            for (const auto &name: names) refs[name] = referenced_registers(program.functions[name]);
+            // an extern can read a register a caller left behind, so those are never private
+            RegSet extern_regs;
+            for (const auto &name: names) extern_regs |= extern_registers(program.functions[name]);
+
+            register_report.clear();
+            for (const auto &name: names) {
+                Function &fn = program.functions[name];
+                RegSet others = extern_regs;
+                for (const auto &[other, other_refs]: refs) {
+                    if (other != name) others |= other_refs;
+                }
+
+                RegSet private_regs = private_registers(name, fn, refs[name], others);
+                bool compacted = private_regs.any() && compact_registers(fn, refs[name], others, private_regs);
+                refs[name] = referenced_registers(fn);
+
+                RegisterPressure pressure{name, refs[name].count(), 0, spills[name], 0, compacted};
+                ControlFlowGraph cfg(fn);
+                if (!cfg.blocks.empty()) {
+                    Liveness liveness(fn, cfg, &summaries, ~private_regs);
+                    for (size_t b: cfg.rpo) {
+                        for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                            pressure.max_live = std::max(pressure.max_live, (liveness.live_after(i) & refs[name]).count());
+                        }
+                        pressure.max_live = std::max(pressure.max_live, (liveness.live_in[b] & refs[name]).count());
+                    }
+                }
+                register_report.push_back(pressure);
+            }
+
+            // after compaction, which can not renumber ranges and may have made registers consecutive
+            for (auto &pressure: register_report) pressure.spills_fused = fuse_spills(program.functions[pressure.function]);
+        }
+
+        // global value numbering: drops pure ops whose destination already holds the value they compute
+        static bool eliminate_redundancies(Function &fn) {
+            ControlFlowGraph cfg(fn);
+            if (cfg.blocks.empty()) return false;
+            SSAForm ssa(fn, cfg);
+            ValueNumbering numbering(fn, cfg, ssa);
+
+            Rewrite rewrite(fn);
+            bool changed = false;
+            for (size_t b: cfg.rpo) {
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    if (ssa.op_def[i] == NONE || ssa.op_prior[i] == NONE) continue;
+                    if (!op_effects(fn.ops[i]).pure) continue;
+                    if (numbering.vn[ssa.op_def[i]] == numbering.vn[ssa.op_prior[i]]) {
+                        rewrite.removed[i] = true;
+                        changed = true;
+                    }
+                }
+            }
+
+            if (changed) rewrite.apply(fn);
+            return changed;
+        }
+
+        // loop invariant code motion into a preheader inserted right before the loop header
+        static bool hoist_loop_invariants(Function &fn) {
+            ControlFlowGraph cfg(fn);
+            if (cfg.blocks.empty()) return false;
+            Liveness liveness(fn, cfg);
+
+            for (const Loop &loop: cfg.loops()) {
+                if (try_hoist(fn, cfg, liveness, loop)) return true;
+            }
+            return false;
+        }
+
+        // imul by the constant 2 becomes iadd of the other operand with itself
+        bool reduce_strength(Function &fn) {
+            ControlFlowGraph cfg(fn);
+            if (cfg.blocks.empty()) return false;
+            SSAForm ssa(fn, cfg);
+            ValueNumbering numbering(fn, cfg, ssa);
+
+            bool changed = false;
+            for (size_t b: cfg.rpo) {
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    Op &op = fn.ops[i];
+                    if (op.type != OpType::IMul) continue;
+
+                    int64_t c;
+                    Word other;
+                    if (numbering.is_int_constant(numbering.vn[ssa.op_reads[i][1]], c)) other = op.args[0];
+                    else if (numbering.is_int_constant(numbering.vn[ssa.op_reads[i][0]], c)) other = op.args[1];
+                    else continue;
+                    if (c != 2) continue;
+
+                    op.type = OpType::IAdd;
+                    op.args[0] = other;
+                    op.args[1] = other;
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+    private:
+        Program &program;
+        SummaryMap summaries{};
+
+        void compute_summaries() {
+            summaries.clear();
+
+            std::unordered_map<std::string, RegisterSummary> local;
+            for (const auto &[name, fn]: program.functions) {
+                RegisterSummary &summary = local[name];
+                for (const auto &op: fn.ops) {
+                    OpEffects e = op_effects(op);
+                    if (e.write >= 0) summary.writes.set(e.write);
+                    if (!e.barrier) continue;
+
+                    const char *target = call_target(op);
+                    switch (op.type) {
+                        case OpType::Ret:
+                        case OpType::Halt:
+                        case OpType::PushN: break;
+                        case OpType::PopN: summary.writes |= register_range(op);
+                            break;
+                        case OpType::Call:
+                        case OpType::TailCall:
+                            if (!target || !program.functions.contains(target)) summary.opaque = true;
+                            break;
+                        case OpType::CallExtern: {
+                            auto it = known_externs().find(target ? target : "");
+                            if (it == known_externs().end()) summary.opaque = true;
+                            else summary.writes |= it->second.writes;
+                        }
+                        break;
+                        default: summary.opaque = true;
+                            break;
+                    }
+                }
+            }
+            summaries = local;
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (const auto &[name, fn]: program.functions) {
+                    RegisterSummary next = local[name];
+                    for (const auto &op: fn.ops) {
+                        if (op.type != OpType::Call && op.type != OpType::TailCall) continue;
+                        auto it = summaries.find(call_target(op) ? call_target(op) : "");
+                        if (it == summaries.end()) continue;
+                        next.writes |= it->second.writes;
+                        next.opaque |= it->second.opaque;
+                    }
+
+                    if (next.opaque) {
+                        next.reads.set();
+                        next.writes.set();
+                        next.stack_neutral = false;
+                    } else {
+                        ControlFlowGraph cfg(fn);
+                        if (!cfg.blocks.empty()) next.reads = Liveness(fn, cfg, &summaries, RegSet()).live_in[0];
+                        next.stack_neutral = is_stack_neutral(fn, cfg);
+                    }
+
+                    RegisterSummary &current = summaries[name];
+                    if (next.reads != current.reads || next.writes != current.writes ||
+                        next.opaque != current.opaque || next.stack_neutral != current.stack_neutral) {
+                        current = next;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        [[nodiscard]] bool is_stack_neutral(const Function &fn, const ControlFlowGraph &cfg) const {
+            if (cfg.blocks.empty()) return true;
+
+            std::vector<int64_t> depth(cfg.blocks.size(), -1);
+            std::vector<size_t> work{0};
+            depth[0] = 0;
+
+            while (!work.empty()) {
+                size_t b = work.back();
+                work.pop_back();
+                int64_t d = depth[b];
+
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    const Op &op = fn.ops[i];
+                    const char *target = call_target(op);
+
+                    switch (op.type) {
+                        case OpType::Push:
+                        case OpType::PushReg: d++;
+                            break;
+                        case OpType::Pop:
+                            if (d == 0) return false;
+                            d--;
+                            break;
+                        case OpType::PushN: d += static_cast<int64_t>(register_range(op).count());
+                            break;
+                        case OpType::PopN: {
+                            auto n = static_cast<int64_t>(register_range(op).count());
+                            if (d < n) return false;
+                            d -= n;
+                        }
+                        break;
+                        case OpType::Call:
+                        case OpType::TailCall: {
+                            auto it = summaries.find(target ? target : "");
+                            if (it == summaries.end() || !it->second.stack_neutral) return false;
+                            if (op.type == OpType::TailCall && d != 0) return false;
+                        }
+                        break;
+                        case OpType::CallExtern:
+                            if (!known_externs().contains(target ? target : "")) return false;
+                            break;
+                        case OpType::CallReg: return false;
+                        case OpType::Ret:
+                            if (d != 0) return false;
+                            break;
+                        default: break;
+                    }
+                }
+
+                const BasicBlock &bb = cfg.blocks[b];
+                if (bb.exits && fn.ops[bb.end - 1].type != OpType::Halt && d != 0) return false;
+                for (size_t succ: bb.succs) {
+                    if (depth[succ] == -1) {
+                        depth[succ] = d;
+                        work.push_back(succ);
+                    } else if (depth[succ] != d) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        // "pushr rX; call f; pop rX" where f cannot change rX, or rX is dead afterwards
+        size_t eliminate_spills(Function &fn) {
+            ControlFlowGraph cfg(fn);
+            if (cfg.blocks.empty()) return 0;
+            Liveness liveness(fn, cfg, &summaries);
+
+            Rewrite rewrite(fn);
+            size_t removed = 0;
+
+            for (size_t b: cfg.rpo) {
+                const BasicBlock &bb = cfg.blocks[b];
+                for (size_t i = bb.begin; i < bb.end; i++) {
+                    const Op &call = fn.ops[i];
+                    RegSet clobbered;
+
+                    if (call.type == OpType::Call) {
+                        auto it = summaries.find(call_target(call) ? call_target(call) : "");
+                        if (it == summaries.end() || it->second.opaque || !it->second.stack_neutral) continue;
+                        clobbered = it->second.writes;
+                    } else if (call.type == OpType::CallExtern) {
+                        auto it = known_externs().find(call_target(call) ? call_target(call) : "");
+                        if (it == known_externs().end()) continue;
+                        clobbered = it->second.writes;
+                    } else {
+                        continue;
+                    }
+
+                    for (size_t m = 1; i >= bb.begin + m && i + m < bb.end; m++) {
+                        const Op &push = fn.ops[i - m];
+                        const Op &pop = fn.ops[i + m];
+                        if (push.type != OpType::PushReg || pop.type != OpType::Pop ||
+                            push.args[0].as_int() != pop.args[0].as_int()) {
+                            break;
+                        }
+
+                        int64_t reg = push.args[0].as_int();
+                        if (reg < 0 || reg >= Config::REGISTER_COUNT) break;
+                        if (clobbered[reg] && liveness.live_after(i + m)[reg]) continue;
+
+                        rewrite.removed[i - m] = rewrite.removed[i + m] = true;
+                        removed++;
+                    }
+                }
+            }
+
+            if (removed > 0) rewrite.apply(fn);
+            return removed;
+        }
+
+        // "pushr r1; pushr r2; pushr r3" -> "pushn r1, r3" and "pop r3; pop r2; pop r1" -> "popn r1, r3"
+        static size_t fuse_spills(Function &fn) {
+            ControlFlowGraph cfg(fn);
+            if (cfg.blocks.empty()) return 0;
+
+            Rewrite rewrite(fn);
+            size_t fused = 0;
+
+            for (const auto &bb: cfg.blocks) {
+                for (size_t i = bb.begin; i < bb.end;) {
+                    OpType type = fn.ops[i].type;
+                    if (type != OpType::PushReg && type != OpType::Pop) {
+                        i++;
+                        continue;
+                    }
+
+                    // pushes go up one register at a time, pops come back down
+                    int64_t step = type == OpType::PushReg ? 1 : -1;
+                    int64_t first = fn.ops[i].args[0].as_int();
+                    size_t end = i + 1;
+                    while (end < bb.end && fn.ops[end].type == type &&
+                           fn.ops[end].args[0].as_int() == first + step * static_cast<int64_t>(end - i)) {
+                        end++;
+                    }
+
+                    int64_t last = first + step * static_cast<int64_t>(end - i - 1);
+                    if (end - i >= 2 && std::min(first, last) >= 0 && std::max(first, last) < Config::REGISTER_COUNT) {
+                        Op &op = fn.ops[i];
+                        op.type = type == OpType::PushReg ? OpType::PushN : OpType::PopN;
+                        op.args[0] = Word::from_reg(std::min(first, last));
+                        op.args[1] = Word::from_reg(std::max(first, last));
+                        for (size_t j = i + 1; j < end; j++) rewrite.removed[j] = true;
+                        fused++;
+                    }
+                    i = end;
+                }
+            }
+
+            if (fused > 0) rewrite.apply(fn);
+            return fused;
+        }
+
+        [[nodiscard]] bool reaches(const std::string &from, const std::string &to) const {
+            std::unordered_set<std::string> seen;
+            std::vector<std::string> work{from};
+
+            while (!work.empty()) {
+                std::string name = work.back();
+                work.pop_back();
+
+                auto fn = program.functions.find(name);
+                if (fn == program.functions.end()) continue;
+                for (const auto &op: fn->second.ops) {
+                    const char *target = call_target(op);
+                    if (!target || op.type == OpType::CallExtern) continue;
+                    if (target == to) return true;
+                    if (seen.insert(target).second) work.emplace_back(target);
+                }
+            }
+            return false;
+        }
+
+        // registers no other function (and no unknown extern) can observe. main is left alone because the
+        // host may read its registers after the program ran, recursive functions because their registers
+        // are shared between activations.
+        RegSet private_registers(const std::string &name, const Function &fn, const RegSet &own,
+                                 const RegSet &others) const {
+            auto it = summaries.find(name);
+            if (name == "main" || it == summaries.end() || it->second.opaque || reaches(name, name)) return {};
+            // a pushn/popn range can not be renumbered register by register
+            for (const auto &op: fn.ops) {
+                if (op.type == OpType::PushN || op.type == OpType::PopN) return {};
+            }
+
+            RegSet candidates = own & ~others;
+            candidates.reset(0);
+
+            ControlFlowGraph cfg(fn);
+            if (cfg.blocks.empty() || candidates.none()) return {};
+
+            // a register read before it is written carries a value from an earlier call
+            Liveness liveness(fn, cfg, &summaries, ~candidates);
+            return candidates & ~liveness.live_in[0];
+        }
+
+        // colors private registers by interference and maps them onto the lowest free registers
+        bool compact_registers(Function &fn, const RegSet &own, const RegSet &others, const RegSet &private_regs) {
+            ControlFlowGraph cfg(fn);
+            Liveness liveness(fn, cfg, &summaries, ~private_regs);
+
+            std::vector<RegSet> interferes(Config::REGISTER_COUNT);
+            for (size_t b: cfg.rpo) {
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    const Op &op = fn.ops[i];
+                    OpEffects e = op_effects(op);
+                    if (e.write < 0 || e.write == FLAG_SLOT || !private_regs[e.write]) continue;
+
+                    RegSet live = liveness.live_after(i) & private_regs;
+                    live.reset(e.write);
+                    // a copy does not make source and destination interfere
+                    if (op.type == OpType::Mov && e.read_count == 1) live.reset(e.reads[0]);
+
+                    interferes[e.write] |= live;
+                    for (int r = 0; r < Config::REGISTER_COUNT; r++) {
+                        if (live[r]) interferes[r].set(e.write);
+                    }
+                }
+            }
+
+            RegSet pool = ~(others | (own & ~private_regs));
+            pool.reset(0);
+            pool.reset(FLAG_SLOT);
+
+            std::array<int, Config::REGISTER_COUNT> color{};
+            color.fill(-1);
+            bool changed = false;
+
+            for (int r = 0; r < Config::REGISTER_COUNT; r++) {
+                if (!private_regs[r]) continue;
+
+                RegSet taken;
+                for (int n = 0; n < Config::REGISTER_COUNT; n++) {
+                    if (interferes[r][n] && color[n] >= 0) taken.set(color[n]);
+                }
+                for (int c = 1; c < Config::REGISTER_COUNT; c++) {
+                    if (pool[c] && !taken[c]) {
+                        color[r] = c;
+                        break;
+                    }
+                }
+                if (color[r] != r) changed = true;
+            }
+
+            if (!changed) return false;
+
+            for (auto &op: fn.ops) {
+                OpEffects e = op_effects(op);
+                for (size_t i = 0; i < Config::OpArgCount; i++) {
+                    int64_t r = op.args[i].as_int();
+                    if (e.reg_args[i] && r >= 0 && r < Config::REGISTER_COUNT && private_regs[r]) {
+                        op.args[i].data.i = color[r];
+                    }
+                }
+                if (is_memory_op(op.type)) {
+                    MemOperand mem = MemOperand::unpack(op.args[2].as_int());
+                    if (mem.index >= 0 && mem.index < Config::REGISTER_COUNT && private_regs[mem.index]) {
+                        mem.index = static_cast<int16_t>(color[mem.index]);
+                        op.args[2] = Word::from_int(mem.pack());
+                    }
+                }
+            }
+            return true;
+        }
+
+        static bool try_hoist(Function &fn, const ControlFlowGraph &cfg, const Liveness &liveness,
+                              const Loop &loop) {
+            size_t header_op = cfg.blocks[loop.header].begin;
+
+            // the preheader must not sit on a path from inside the loop
+            if (header_op > 0 && !ends_flow(fn.ops[header_op - 1].type) && loop.body[cfg.block_of[header_op - 1]]) {
+                return false;
+            }
+
+            std::array<int, SLOT_COUNT> defs{};
+            std::vector<std::pair<size_t, size_t> > exits; // exiting block, target block (NONE = function exit)
+            for (size_t b: loop.blocks) {
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    OpEffects e = op_effects(fn.ops[i]);
+                    if (e.barrier) return false;
+                    if (e.write >= 0) defs[e.write]++;
+                }
+                if (cfg.blocks[b].exits) exits.emplace_back(b, NONE);
+                for (size_t s: cfg.blocks[b].succs) {
+                    if (!loop.body[s]) exits.emplace_back(b, s);
+                }
+            }
+
+            const RegSet &header_live = liveness.live_in[loop.header];
+
+            auto invariant = [&](const OpEffects &e) {
+                for (size_t r = 0; r < e.read_count; r++) {
+                    if (defs[e.reads[r]] != 0) return false;
+                }
+                return true;
+            };
+
+            // the loop's single definition of reg may move to the preheader
+            auto movable_def = [&](int reg, size_t block) {
+                if (defs[reg] != 1 || header_live[reg]) return false;
+                for (auto [from, to]: exits) {
+                    bool live = to == NONE || liveness.live_in[to][reg];
+                    if (live && !cfg.dominates(block, from)) return false;
+                }
+                return true;
+            };
+
+            auto hoistable = [&](const Op &op) {
+                OpEffects e = op_effects(op);
+                return e.pure && e.write >= 0 && e.write != FLAG_SLOT &&
+                       op.type != OpType::Inc && op.type != OpType::Dec && invariant(e);
+            };
+
+            Rewrite rewrite(fn);
+            std::vector<Op> preheader;
+            bool changed = true;
+
+            while (changed) {
+                changed = false;
+                for (size_t b: loop.blocks) {
+                    for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                        if (rewrite.removed[i] || !hoistable(fn.ops[i])) continue;
+                        int dest = op_effects(fn.ops[i]).write;
+
+                        if (movable_def(dest, b)) {
+                            rewrite.removed[i] = true;
+                            preheader.push_back(fn.ops[i]);
+                            defs[dest]--;
+                            changed = true;
+                            continue;
+                        }
+
+                        // "op -> r0; mov r0, rX" pairs move together when r0 is only a temporary
+                        if (dest != 0 || i + 1 >= cfg.blocks[b].end || rewrite.removed[i + 1]) continue;
+                        const Op &next = fn.ops[i + 1];
+                        if (next.type != OpType::Mov || !next.args[0].has_flag(WordFlag::Register) ||
+                            next.args[0].as_int() != 0) {
+                            continue;
+                        }
+
+                        int target = op_effects(next).write;
+                        if (target <= 0 || header_live[0] || liveness.live_after(i + 1)[0]) continue;
+                        if (!movable_def(target, b)) continue;
+
+                        rewrite.removed[i] = rewrite.removed[i + 1] = true;
+                        preheader.push_back(fn.ops[i]);
+                        preheader.push_back(next);
+                        defs[0]--;
+                        defs[target]--;
+                        changed = true;
+                    }
+                }
+            }
+
+            if (preheader.empty()) return false;
+
+            rewrite.insert_before[header_op] = preheader;
+            for (size_t b: loop.blocks) {
+                for (size_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                    if (is_jump(fn.ops[i].type) && jump_target(fn.ops[i]) == static_cast<int64_t>(header_op)) {
+                        rewrite.bypass.insert(i);
+                    }
+                }
+            }
+            rewrite.apply(fn);
+            return true;
+        }
+    };
+}
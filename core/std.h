@@ -1,20 +1,482 @@
 #ifndef STD_H
 #define STD_H
 
-#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <string>
 
 #include "cir.h"
+#include "helpers/hash.h"
+#include "helpers/memops.h"
+#include "helpers/numeric.h"
+#include "helpers/sort.h"
 
+// std.print prints r0, the other externs take their arguments in r1, r2, ... and leave their result in r0.
+// Buffers are a pointer and an element count, see doc/std.md.
 // TODO: extend
-// TODO: format function
 namespace cir_std {
-    void print(CIR &cir) {
-        cir.getr(0).print();
-        std::cout << std::endl;
+    namespace detail {
+        inline double number(const Word &w) {
+            return w.type == WordType::Float ? w.as_float() : static_cast<double>(w.as_int());
+        }
+
+        template<typename T>
+        T scalar(const Word &w) {
+            if constexpr (std::is_same_v<T, double>) return number(w);
+            else return w.type == WordType::Float ? static_cast<int64_t>(w.as_float()) : w.as_int();
+        }
+
+        template<typename T>
+        Word word(T value) {
+            if constexpr (std::is_same_v<T, double>) return Word::from_float(value);
+            else return Word::from_int(value);
+        }
+
+        template<typename VM>
+        std::string_view text(VM &cir, uint16_t r, const char *name) {
+            const Word &w = cir.getr(r);
+            if (!w.is_string()) {
+                throw std::runtime_error(std::string(name) + ": r" + std::to_string(r) + " is not a string");
+            }
+            return w.as_string();
+        }
+
+        // the string in r1, or r2 bytes at the pointer in r1
+        template<typename VM>
+        std::string_view bytes(VM &cir) {
+            if (cir.getr(1).is_string()) return cir.getr(1).as_string();
+            int64_t n = cir.getr(2).as_int();
+            return {cir.template buffer<char>(1, n), static_cast<size_t>(n)};
+        }
+
+        inline bool blank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+        // std::from_chars, which also takes a leading +
+        template<typename T>
+        std::from_chars_result read_number(const char *first, const char *last, T &value) {
+            if (last - first > 1 && first[0] == '+' && first[1] != '-') first++;
+            return std::from_chars(first, last, value);
+        }
+
+        [[noreturn]] inline void bad_number(const char *name, std::string_view text, size_t at, std::errc error) {
+            std::string_view field = text.substr(at, 24);
+            field = field.substr(0, field.find('\n'));
+            const char *problem = error == std::errc::result_out_of_range ? ": out of range" : ": no number";
+            throw std::runtime_error(std::string(name) + problem + " at byte " + std::to_string(at) + " \""
+                                     + std::string(field) + "\"");
+        }
+
+        // first needle at or after byte from, npos when there is none
+        inline size_t find(std::string_view haystack, std::string_view needle, size_t from) {
+            const auto *p = reinterpret_cast<const uint8_t *>(haystack.data());
+            const auto *n = reinterpret_cast<const uint8_t *>(needle.data());
+            size_t rest = haystack.size() - from;
+            const uint8_t *at = needle.size() == 1 ? memops::kernels().find(p + from, n[0], rest)
+                                                   : memops::kernels().search(p + from, rest, n, needle.size());
+            return at ? at - p : std::string_view::npos;
+        }
+    }
+
+    // std.print, std.write and std.flush: output goes through the VM's buffer and is flushed when the program ends
+
+    template<typename VM>
+    void print(VM &cir) {
+        Word::FormatBuffer scratch;
+        cir.output().write(cir.getr(0).format(scratch));
+        cir.output().put('\n');
+    }
+
+    template<typename VM>
+    void write(VM &cir) {
+        Word::FormatBuffer scratch;
+        cir.output().write(cir.getr(0).format(scratch));
+    }
+
+    template<typename VM>
+    void flush(VM &cir) {
+        cir.output().flush();
+    }
+
+    // r1 = format string, r0 = the string with each {} replaced by the next of r2, r3, ... as std.print would print
+    // it. {:.N} gives a float N decimals, {{ and }} are literal braces.
+    template<typename VM>
+    void format(VM &cir) {
+        std::string_view pattern = detail::text(cir, 1, "std.format");
+        std::string result;
+        result.reserve(pattern.size() + 16);
+        Word::FormatBuffer scratch;
+        uint16_t next = 2;
+
+        for (size_t i = 0; i < pattern.size(); i++) {
+            char c = pattern[i];
+            if (c == '}') {
+                if (i + 1 == pattern.size() || pattern[i + 1] != '}') {
+                    throw std::runtime_error("std.format: unmatched } at " + std::to_string(i));
+                }
+                result += '}';
+                i++;
+                continue;
+            }
+            if (c != '{') {
+                result += c;
+                continue;
+            }
+            if (i + 1 < pattern.size() && pattern[i + 1] == '{') {
+                result += '{';
+                i++;
+                continue;
+            }
+
+            size_t close = pattern.find('}', i);
+            if (close == std::string_view::npos) {
+                throw std::runtime_error("std.format: unclosed { at " + std::to_string(i));
+            }
+            std::string_view spec = pattern.substr(i + 1, close - i - 1);
+            int precision = 2;
+            if (!spec.empty()) {
+                auto [end, error] = spec.size() > 2 && spec.starts_with(":.")
+                                        ? std::from_chars(spec.data() + 2, spec.data() + spec.size(), precision)
+                                        : std::from_chars_result{spec.data(), std::errc::invalid_argument};
+                if (error != std::errc{} || end != spec.data() + spec.size() || precision < 0) {
+                    throw std::runtime_error("std.format: bad placeholder {" + std::string(spec) + "}");
+                }
+                precision = std::min(precision, 17);
+            }
+            if (next >= VM::PolicyType::REGISTER_COUNT) throw std::runtime_error("std.format: too many placeholders");
+            result += cir.getr(next++).format(scratch, precision);
+            i = close;
+        }
+        cir.getr(0) = Word::from_text(result);
+    }
+
+    // std.math: scalars
+
+    template<typename VM, auto F>
+    void math(VM &cir) {
+        cir.getr(0) = Word::from_float(F(detail::number(cir.getr(1))));
+    }
+
+    template<typename VM>
+    void math_abs(VM &cir) {
+        const Word &x = cir.getr(1);
+        cir.getr(0) = x.type == WordType::Float ? Word::from_float(std::fabs(x.as_float()))
+                                                : Word::from_int(x.as_int() < 0 ? -x.as_int() : x.as_int());
+    }
+
+    template<typename VM>
+    void math_pow(VM &cir) {
+        cir.getr(0) = Word::from_float(std::pow(detail::number(cir.getr(1)), detail::number(cir.getr(2))));
+    }
+
+    // std.vec: r1 = buffer, r2 = element count
+
+    template<typename VM, typename T>
+    void vec_sum(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        cir.getr(0) = detail::word(numeric::sum(cir.template buffer<T>(1, n), n));
+    }
+
+    // null for an empty buffer
+    template<typename VM, typename T, bool Max>
+    void vec_min_max(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        const T *p = cir.template buffer<T>(1, n);
+        if (n == 0) cir.getr(0) = Word::from_null();
+        else cir.getr(0) = detail::word(Max ? numeric::max(p, n) : numeric::min(p, n));
+    }
+
+    // r3 = second buffer
+    template<typename VM, typename T>
+    void vec_dot(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        cir.getr(0) = detail::word(numeric::dot(cir.template buffer<T>(1, n), cir.template buffer<T>(3, n), n));
+    }
+
+    template<typename VM, typename T>
+    void vec_prefix_sum(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        numeric::prefix_sum(cir.template buffer<T>(1, n), n);
+    }
+
+    // r3 = factor
+    template<typename VM, typename T>
+    void vec_scale(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        numeric::scale(cir.template buffer<T>(1, n), n, detail::scalar<T>(cir.getr(3)));
+    }
+
+    // buffer += r3 * the buffer in r4
+    template<typename VM, typename T>
+    void vec_axpy(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        T *y = cir.template buffer<T>(1, n);
+        numeric::axpy(y, n, detail::scalar<T>(cir.getr(3)), cir.template buffer<T>(4, n));
+    }
+
+    // doubles in place
+    template<typename VM, auto F>
+    void vec_map(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        numeric::map(cir.template buffer<double>(1, n), n, F);
+    }
+
+    template<typename VM>
+    void init_math(VM &cir) {
+        cir.set_extern_fn("std.math.abs", math_abs<VM>);
+        cir.set_extern_fn("std.math.pow", math_pow<VM>);
+        cir.set_extern_fn("std.math.sqrt", math<VM, [](double x) { return std::sqrt(x); }>);
+        cir.set_extern_fn("std.math.exp", math<VM, [](double x) { return std::exp(x); }>);
+        cir.set_extern_fn("std.math.log", math<VM, [](double x) { return std::log(x); }>);
+        cir.set_extern_fn("std.math.sin", math<VM, [](double x) { return std::sin(x); }>);
+        cir.set_extern_fn("std.math.cos", math<VM, [](double x) { return std::cos(x); }>);
+        cir.set_extern_fn("std.math.floor", math<VM, [](double x) { return std::floor(x); }>);
+        cir.set_extern_fn("std.math.ceil", math<VM, [](double x) { return std::ceil(x); }>);
+
+        cir.set_extern_fn("std.vec.sum.i64", vec_sum<VM, int64_t>);
+        cir.set_extern_fn("std.vec.sum.f64", vec_sum<VM, double>);
+        cir.set_extern_fn("std.vec.min.i64", vec_min_max<VM, int64_t, false>);
+        cir.set_extern_fn("std.vec.min.f64", vec_min_max<VM, double, false>);
+        cir.set_extern_fn("std.vec.max.i64", vec_min_max<VM, int64_t, true>);
+        cir.set_extern_fn("std.vec.max.f64", vec_min_max<VM, double, true>);
+        cir.set_extern_fn("std.vec.dot.i64", vec_dot<VM, int64_t>);
+        cir.set_extern_fn("std.vec.dot.f64", vec_dot<VM, double>);
+        cir.set_extern_fn("std.vec.prefix_sum.i64", vec_prefix_sum<VM, int64_t>);
+        cir.set_extern_fn("std.vec.prefix_sum.f64", vec_prefix_sum<VM, double>);
+        cir.set_extern_fn("std.vec.scale.i64", vec_scale<VM, int64_t>);
+        cir.set_extern_fn("std.vec.scale.f64", vec_scale<VM, double>);
+        cir.set_extern_fn("std.vec.axpy.i64", vec_axpy<VM, int64_t>);
+        cir.set_extern_fn("std.vec.axpy.f64", vec_axpy<VM, double>);
+        cir.set_extern_fn("std.vec.map.sqrt", vec_map<VM, [](double x) { return std::sqrt(x); }>);
+        cir.set_extern_fn("std.vec.map.abs", vec_map<VM, [](double x) { return std::fabs(x); }>);
+        cir.set_extern_fn("std.vec.map.exp", vec_map<VM, [](double x) { return std::exp(x); }>);
+        cir.set_extern_fn("std.vec.map.log", vec_map<VM, [](double x) { return std::log(x); }>);
+        cir.set_extern_fn("std.vec.map.sin", vec_map<VM, [](double x) { return std::sin(x); }>);
+        cir.set_extern_fn("std.vec.map.cos", vec_map<VM, [](double x) { return std::cos(x); }>);
+        cir.set_extern_fn("std.vec.map.floor", vec_map<VM, [](double x) { return std::floor(x); }>);
+        cir.set_extern_fn("std.vec.map.ceil", vec_map<VM, [](double x) { return std::ceil(x); }>);
+    }
+
+    // std.sort / std.search: in place on r1 = buffer, r2 = element count
+
+    template<typename VM, typename T>
+    void sort(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        sorting::sort(cir.template buffer<T>(1, n), n);
+    }
+
+    template<typename VM, typename T>
+    void parallel_sort(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        sorting::parallel_sort(cir.template buffer<T>(1, n), n, ThreadPool::shared());
+    }
+
+    // r2 = pair count, every pair is a key followed by its value. Stable, pairs with equal keys keep their order.
+    template<typename VM, typename Pair>
+    void sort_pairs(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        if (n > INT64_MAX / 2) throw std::runtime_error("std.sort.kv: pair count overflows the buffer");
+        static_assert(sizeof(Pair) == 2 * sizeof(int64_t));
+        auto *pairs = reinterpret_cast<Pair *>(cir.template buffer<int64_t>(1, n * 2));
+        sorting::stable_sort(pairs, n);
+    }
+
+    // r3 = key, r0 = index of the first element not less than it, the buffer has to be sorted
+    template<typename VM, typename T>
+    void lower_bound(VM &cir) {
+        int64_t n = cir.getr(2).as_int();
+        const T *p = cir.template buffer<T>(1, n);
+        cir.getr(0) = Word::from_int(static_cast<int64_t>(sorting::lower_bound(p, n, detail::scalar<T>(cir.getr(3)))));
+    }
+
+    template<typename VM>
+    void init_sort(VM &cir) {
+        cir.set_extern_fn("std.sort.i64", sort<VM, int64_t>);
+        cir.set_extern_fn("std.sort.f64", sort<VM, double>);
+        cir.set_extern_fn("std.sort.kv", sort_pairs<VM, sorting::KeyValue>);
+        cir.set_extern_fn("std.sort.kv.f64", sort_pairs<VM, sorting::KeyValueF64>);
+        cir.set_extern_fn("std.sort.parallel.i64", parallel_sort<VM, int64_t>);
+        cir.set_extern_fn("std.sort.parallel.f64", parallel_sort<VM, double>);
+        cir.set_extern_fn("std.search.lower_bound.i64", lower_bound<VM, int64_t>);
+        cir.set_extern_fn("std.search.lower_bound.f64", lower_bound<VM, double>);
+    }
+
+    // std.str: r1 = string, r2 = the string to look for
+
+    // r0 = byte index of the first r2 in r1, -1 when there is none
+    template<typename VM>
+    void str_find(VM &cir) {
+        size_t at = detail::find(detail::text(cir, 1, "std.str.find"), detail::text(cir, 2, "std.str.find"), 0);
+        cir.getr(0) = Word::from_int(at == std::string_view::npos ? -1 : static_cast<int64_t>(at));
+    }
+
+    // r0 = number of r2 in r1 that do not overlap
+    template<typename VM>
+    void str_count(VM &cir) {
+        std::string_view text = detail::text(cir, 1, "std.str.count");
+        std::string_view needle = detail::text(cir, 2, "std.str.count");
+        if (needle.empty()) throw std::runtime_error("std.str.count: empty needle");
+
+        size_t count = 0;
+        if (needle.size() == 1) {
+            count = memops::kernels().count(reinterpret_cast<const uint8_t *>(text.data()), needle[0], text.size());
+        } else {
+            for (size_t at = detail::find(text, needle, 0); at != std::string_view::npos;
+                 at = detail::find(text, needle, at + needle.size())) {
+                count++;
+            }
+        }
+        cir.getr(0) = Word::from_int(static_cast<int64_t>(count));
+    }
+
+    // r0 = new array of the parts of r1 between the separators in r2. Parts are slices of r1 rather than copies and
+    // all of them share one allocation.
+    template<typename VM>
+    void str_split(VM &cir) {
+        const Word &source = cir.getr(1);
+        std::string_view text = detail::text(cir, 1, "std.str.split");
+        std::string_view separator = detail::text(cir, 2, "std.str.split");
+        if (separator.empty()) throw std::runtime_error("std.str.split: empty separator");
+
+        // counted first so the array and the slices are allocated once
+        auto each_part = [&](auto &&fn) {
+            size_t start = 0;
+            for (size_t at = detail::find(text, separator, 0); at != std::string_view::npos;
+                 at = detail::find(text, separator, start)) {
+                fn(start, at - start);
+                start = at + separator.size();
+            }
+            fn(start, text.size() - start);
+        };
+        size_t parts = 0, shared = 0;
+        each_part([&](size_t, size_t length) {
+            parts++;
+            shared += length > sizeof(Word::data);
+        });
+
+        auto *array = VM::Array::create(cir.get_heap());
+        array->reserve(parts);
+        strings::SliceGroup *group = shared ? strings::group(shared) : nullptr;
+        each_part([&](size_t start, size_t length) { array->push(source.substring(start, length, group)); });
+        if (group) strings::release(group);
+        cir.getr(0) = Word::from_ptr(array);
+    }
+
+    // std.hash: r1 = string, or a pointer and r2 = byte count
+
+    template<typename VM>
+    void hash(VM &cir) {
+        std::string_view bytes = detail::bytes(cir);
+        cir.getr(0) = Word::from_int(static_cast<int64_t>(hashing::wyhash(bytes.data(), bytes.size())));
+    }
+
+    template<typename VM>
+    void hash_crc32c(VM &cir) {
+        std::string_view bytes = detail::bytes(cir);
+        cir.getr(0) = Word::from_int(hashing::crc32c(bytes.data(), bytes.size()));
+    }
+
+    // std.parse and std.fmt
+
+    // r1 = string holding one number, blanks around it are allowed
+    template<typename VM, typename T>
+    void parse(VM &cir) {
+        const char *name = std::is_same_v<T, double> ? "std.parse.f64" : "std.parse.i64";
+        std::string_view text = detail::text(cir, 1, name);
+        const char *first = text.data(), *last = text.data() + text.size();
+        while (first != last && detail::blank(*first)) first++;
+        while (last != first && detail::blank(last[-1])) last--;
+
+        T value;
+        auto [end, error] = detail::read_number(first, last, value);
+        if (error != std::errc{} || end != last) detail::bad_number(name, text, first - text.data(), error);
+        cir.getr(0) = detail::word(value);
+    }
+
+    // r1 = text of numbers separated by any of the bytes of r2, blanks around a number are allowed and so is a
+    // separator at the very end (a trailing newline). r1, r2 = new heap buffer of the numbers and their count, ready
+    // for std.vec and std.sort. r0 = the count as well.
+    template<typename VM, typename T>
+    void parse_batch(VM &cir) {
+        const char *name = std::is_same_v<T, double> ? "std.parse.batch.f64" : "std.parse.batch.i64";
+        std::string_view text = detail::text(cir, 1, name);
+        std::string_view separators = detail::text(cir, 2, name);
+        if (separators.empty()) throw std::runtime_error(std::string(name) + ": no separators");
+
+        std::array<bool, 256> separator{}, skip{};
+        for (char c: separators) separator[static_cast<uint8_t>(c)] = true;
+        for (char c: {' ', '\t', '\r', '\n'}) skip[static_cast<uint8_t>(c)] = !separator[static_cast<uint8_t>(c)];
+
+        // one more than the separators is enough room, so the buffer is allocated once and filled in place
+        const auto *bytes = reinterpret_cast<const uint8_t *>(text.data());
+        size_t capacity = 1;
+        for (char c: separators) capacity += memops::kernels().count(bytes, static_cast<uint8_t>(c), text.size());
+        if (capacity > SIZE_MAX / sizeof(T)) throw std::runtime_error(std::string(name) + ": input too large");
+        Word buffer = cir.allocate(capacity * sizeof(T));
+        if (!buffer.as_ptr()) {
+            throw std::runtime_error(std::string(name) + ": no heap memory for " + std::to_string(capacity)
+                                     + " numbers");
+        }
+
+        T *out = static_cast<T *>(buffer.as_ptr());
+        size_t count = 0;
+        const char *at = text.data(), *last = text.data() + text.size();
+        while (at != last) {
+            while (at != last && skip[static_cast<uint8_t>(*at)]) at++;
+            if (at == last) break;
+            auto [end, error] = detail::read_number(at, last, out[count]);
+            if (error != std::errc{}) detail::bad_number(name, text, at - text.data(), error);
+            count++;
+            at = end;
+            while (at != last && skip[static_cast<uint8_t>(*at)]) at++;
+            if (at == last) break;
+            if (!separator[static_cast<uint8_t>(*at)]) detail::bad_number(name, text, end - text.data(), std::errc{});
+            at++;
+        }
+
+        cir.getr(0) = Word::from_int(static_cast<int64_t>(count));
+        cir.getr(1) = buffer;
+        cir.getr(2) = Word::from_int(static_cast<int64_t>(count));
+    }
+
+    // r0 = string of r1, floats in the shortest form that parses back to the same value
+    template<typename VM, typename T>
+    void fmt(VM &cir) {
+        char text[32];
+        char *end = std::to_chars(text, text + sizeof(text), detail::scalar<T>(cir.getr(1))).ptr;
+        cir.getr(0) = Word::from_text({text, static_cast<size_t>(end - text)});
+    }
+
+    template<typename VM>
+    void init_numbers(VM &cir) {
+        cir.set_extern_fn("std.parse.i64", parse<VM, int64_t>);
+        cir.set_extern_fn("std.parse.f64", parse<VM, double>);
+        cir.set_extern_fn("std.parse.batch.i64", parse_batch<VM, int64_t>);
+        cir.set_extern_fn("std.parse.batch.f64", parse_batch<VM, double>);
+        cir.set_extern_fn("std.fmt.i64", fmt<VM, int64_t>);
+        cir.set_extern_fn("std.fmt.f64", fmt<VM, double>);
+    }
+
+    template<typename VM>
+    void init_strings(VM &cir) {
+        cir.set_extern_fn("std.str.find", str_find<VM>);
+        cir.set_extern_fn("std.str.count", str_count<VM>);
+        cir.set_extern_fn("std.str.split", str_split<VM>);
+        cir.set_extern_fn("std.hash", hash<VM>);
+        cir.set_extern_fn("std.hash.crc32c", hash_crc32c<VM>);
     }
 
-    void init_std(CIR &cir) {
-        cir.set_extern_fn("std.print", print);
+    template<typename VM>
+    void init_std(VM &cir) {
+        cir.set_extern_fn("std.print", print<VM>);
+        cir.set_extern_fn("std.write", write<VM>);
+        cir.set_extern_fn("std.flush", flush<VM>);
+        cir.set_extern_fn("std.format", format<VM>);
+        init_math(cir);
+        init_sort(cir);
+        init_strings(cir);
+        init_numbers(cir);
     }
 }
 
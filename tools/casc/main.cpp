@@ -0,0 +1,58 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+// NOTE: No need for implementation we will link with .so
+//#define CIR_IMPLEMENTATION
+#include "core/cir.h"
+
+#include "core/asm.h"
+#include "core/aot.h"
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: casc <program.cas|program.cbc> [-o output.cpp] [-O0]" << std::endl;
+        return 1;
+    }
+
+    std::string input = argv[1];
+    std::string output;
+    bool optimize = true;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc) output = argv[++i];
+        else if (arg == "-O0" || arg == "--no-optimize") optimize = false;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (output.empty()) output = input.substr(0, input.find_last_of('.')) + ".native.cpp";
+
+    try {
+        CIR vm;
+        if (input.ends_with(".cbc")) {
+            std::ifstream f(input, std::ios::binary);
+            if (!f) throw std::runtime_error("Cannot open bytecode file: " + input);
+            std::vector<uint8_t> bytecode((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+            vm.from_bytecode(bytecode);
+        } else {
+            // assembled exactly like cas does, so the fingerprints match the program cas runs
+            Assembler assembler;
+            assembler.show_better_practice = false;
+            assembler.optimize = optimize;
+            assembler.assemble_file(input);
+            vm.load_program(assembler.get_program());
+        }
+
+        std::ofstream out(output);
+        if (!out) throw std::runtime_error("Cannot open output file: " + output);
+        out << NativeEmitter(std::as_const(vm).get_program()).emit();
+    } catch (const std::exception &e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "[SUCCESS] C++ written to: " << output << std::endl;
+    return 0;
+}
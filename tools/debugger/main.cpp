@@ -11,6 +11,8 @@
 #include "core/asm.h"
 
 std::string op_type_to_string(OpType type, Assembler &assembler) {
+    // the interpreter rewrites ops into quickened forms while running, show them as what they were
+    type = generic_op(type);
     for (const auto &i: assembler.opcode_map) {
         if (i.second.type == type) return i.first;
     }
@@ -20,7 +22,7 @@ std::string op_type_to_string(OpType type, Assembler &assembler) {
 class Debugger {
 private:
     CIR &vm;
-    Program &program;
+    const Program &program;
     Assembler &assembler;
     std::set<size_t> breakpoints;
     bool step_mode = true;
@@ -87,36 +89,25 @@ private:
     }
 
 public:
-    Debugger(CIR &vm, Program &prog, Assembler &asm_)
+    Debugger(CIR &vm, const Program &prog, Assembler &asm_)
         : vm(vm), program(prog), assembler(asm_) {
     }
 
     void debug_function(const std::string &name) {
-        program.state.cf = name;
-        program.state.running = true;
-
-        if (!program.functions.contains(name)) {
-            throw std::runtime_error("Function not found: " + name);
-        }
-        program.functions[name].co = 0;
+        vm.enter_function(vm.function_id(name));
 
         std::cout << "\n=== Debugging function: " << name << " ===" << std::endl;
         print_help();
 
         while (program.state.running) {
-            Function &fn = program.functions[program.state.cf];
+            Function &fn = vm.get_function(program.state.cf);
 
             if (fn.co >= fn.ops.size()) {
-                if (program.state.call_stack.empty()) {
-                    program.state.running = false;
+                if (!vm.return_from_function()) {
+                    vm.output().flush();
                     std::cout << "\nProgram ended." << std::endl;
                     break;
                 }
-
-                CallFrame cf = program.state.call_stack.back();
-                program.state.call_stack.pop_back();
-                program.state.cf = cf.name;
-                program.functions[program.state.cf].co = cf.co;
                 continue;
             }
 
@@ -126,6 +117,8 @@ public:
             }
 
             if (step_mode) {
+                // program output comes before the prompt
+                vm.output().flush();
                 print_current_instruction(fn);
 
                 std::string cmd = get_command();
@@ -179,8 +172,7 @@ public:
                 }
             }
 
-            vm.execute_op(fn, fn.ops[fn.co]);
-            fn.co++;
+            vm.step();
         }
     }
 };
@@ -208,7 +200,7 @@ int main(int argc, char *argv[]) {
     vm.from_bytecode(bytecode);
     cir_std::init_std(vm);
 
-    Program &prog = vm.get_program();
+    const Program &prog = std::as_const(vm).get_program();
 
     Debugger debugger(vm, prog, assembler);
     debugger.debug_function("main");
@@ -23,6 +23,17 @@ void disassemble_function(const std::string &name, const Function &fn, Assembler
         const Op &op = fn.ops[i];
         std::cout << "  [" << i << "] " << op_type_to_string(op.type, assembler);
 
+        if (is_memory_op(op.type)) {
+            MemOperand mem = MemOperand::unpack(op.args[2].as_int());
+            std::cout << " ";
+            op.args[0].print();
+            std::cout << ", [r" << op.args[1].as_int();
+            if (mem.index >= 0) std::cout << " + r" << mem.index << "*" << static_cast<int>(mem.scale);
+            if (mem.offset != 0) std::cout << (mem.offset < 0 ? " - " : " + ") << std::abs(static_cast<int64_t>(mem.offset));
+            std::cout << "]" << std::endl;
+            continue;
+        }
+
         for (size_t j = 0; j < Config::OpArgCount; j++) {
             const Word &arg = op.args[j];
             if (arg.type == WordType::Null && arg.flags == 0) continue;
@@ -64,7 +75,7 @@ int main(int argc, char *argv[]) {
 
     vm.from_bytecode(bytecode);
 
-    Program &prog = vm.get_program();
+    const Program &prog = std::as_const(vm).get_program();
     for (const auto &[name, func]: prog.functions) {
         disassemble_function(name, func, assembler);
         std::cout << std::endl;